@@ -6,6 +6,7 @@ OPT=-O3
 clang-18 \
 	${OPT} \
 	--target=wasm32 \
+	-msimd128 \
 	-fvectorize \
 	-flto \
 	-ffast-math \
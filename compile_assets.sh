@@ -1,7 +1,9 @@
 #!/bin/sh
 
 FILE=include/assets.h
+PACK=data/assets.pack
 TOOLS_PATH=$1
+SECTIONS=$(mktemp -d)
 
 echo "// assets.h" > ${FILE}
 echo "#ifndef _ASSETS_H" >> ${FILE}
@@ -10,15 +12,22 @@ echo "#define _ASSETS_H" >> ${FILE}
 for OBJ_PATH in data/mesh/*.obj; do
 	NAME=${OBJ_PATH%.obj}
 	NAME=${NAME##*/}
-	${TOOLS_PATH}objtoc ${OBJ_PATH} ${NAME} >> ${FILE}
+	${TOOLS_PATH}objtoc ${OBJ_PATH} ${NAME} -b ${SECTIONS}/${NAME}.bin
 done
 
+# static geometry is baked with the light that the game starts with
+${TOOLS_PATH}lightbake -l 0 2.5 -4.5 2 1.5 ${SECTIONS}/room.bin ${SECTIONS}/room_floor.bin
+
 for PNG_PATH in data/texture/*.png; do
 	NAME=${PNG_PATH%.png}
 	NAME=${NAME##*/}
-	${TOOLS_PATH}pngtoc ${PNG_PATH} ${NAME} >> ${FILE}
+	${TOOLS_PATH}pngtoc ${PNG_PATH} ${NAME} -m -s 4 -f palette -b ${SECTIONS}/${NAME}.bin
 done
 
+# meshes and textures go into the pack, only their declarations end up in the header
+${TOOLS_PATH}pack ${PACK} ${SECTIONS}/*.bin >> ${FILE}
+rm -r ${SECTIONS}
+
 for TTF_PATH in data/font/*.ttf; do
 	NAME=${TTF_PATH%.ttf}
 	NAME=${NAME##*/}
@@ -9,17 +9,37 @@
 #define RASTER_HEIGHT     (240)
 #define WINDOW_WIDTH      (800)
 #define WINDOW_HEIGHT     (600)
+#define TILE_SIZE         (32)
+#define ASSET_PACK_PATH   "data/assets.pack"
+#define SHADOW_MAP_SIZE   (128) // largest shadow map face, the renderer reserves its shadow map memory for it
 const v3 WORLD_UP         = V3(0, 1, 0);
 f32 LIGHT_AMBIENCE        = 1.0f / (f32)UINT8_MAX;
+f32 LIGHT_CUTOFF          = 1.0f / (f32)UINT8_MAX; // intensity at which a light is considered out of range
+f32 SHADOW_BIAS           = 0.02f; // fraction of the distance to the light that an occluder has to be in front of a surface
+f32 SHADOW_NEAR           = 0.05f;
 f32 CAMERA_ZFAR           = 35.0f;
 f32 CAMERA_ZNEAR          = 0.8f;
 f32 CAMERA_FOV            = 50.0f;
 bool DITHERING            = false;
+i32 DITHER_SIZE           = 4; // size of the bayer matrix used for dithering, 2, 4 or 8
+u8 DITHER_BITS[3]         = { 5, 6, 5 }; // bits of the red, green and blue channels that dithering quantizes to
 bool FOG                  = false;
+bool VERTEX_FOG           = false; // fog meshes per vertex while they are drawn, instead of in the post processing
 bool EDGE_DETECTION       = false;
+bool EDGE_DETECTION_DEPTH = false; // find edges from the depth buffer rather than the normal buffer, always the case with NO_NORMAL_BUFFER
 bool RENDER_VERTICES      = false;
+bool TILE_RENDERING       = false;
+bool BILINEAR_FILTERING   = false;
+bool SHADOW_FILTERING     = true;
 Color FOG_COLOR           = COLOR_RGB(0, 0, 0);
+f32 FOG_DENSITY           = 500.0f * 150.0f * 4.0f; // fog = 1 / (1 + density * d^3), where d is the depth distance to the far plane
 Color EDGE_DETECTION_COLOR = COLOR_RGB(0, 0, 0);
+f32 EDGE_DEPTH_THRESHOLD  = 0.5f; // second difference of the depth, relative to the depth gradient, from which a pixel is on an edge
+bool EDGE_DETECTION_LOW_RES = false; // do edge detection at the resolution of the low resolution effects
+bool AMBIENT_OCCLUSION    = false;
+f32 AMBIENT_OCCLUSION_RADIUS = 1.0f; // in world units, how far away surfaces occlude each other
+f32 AMBIENT_OCCLUSION_STRENGTH = 1.0f;
+i32 LOW_RES_SCALE         = 2; // the screen space effects that are expensive (ambient occlusion) are done at 1/1, 1/2 or 1/4 of the resolution
 const f32 DT_MIN          = 1.0f / 1000.0f;
 const f32 DT_MAX          = 1.0f / 10.0f;
 
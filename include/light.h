@@ -16,9 +16,20 @@ typedef struct Light {
   f32 radius;
   f32 ambience;
   Light_type type;
+  u32 shadow_size; // resolution of each face of the shadow map, 0 if the light doesn't cast shadows
+  // spot lights only
+  v3 direction;
+  f32 cos_inner; // full intensity inside the inner cone, fading out towards the outer cone
+  f32 cos_outer;
 } Light;
 
 Light light_create(v3 pos, f32 strength, f32 radius);
+Light light_create_spot(v3 pos, v3 direction, f32 strength, f32 radius, f32 inner_angle, f32 outer_angle);
 f32 light_calculate_contribution(Light light, v3 pos, v3 normal);
+f32 light_calculate_intensity(Light light, v3 pos, v3 normal);
+void light_accumulate_intensity4(const Light* light, const f32* x, const f32* y, const f32* z, const f32* nx, const f32* ny, const f32* nz, f32* intensity);
+f32 light_get_range(Light light);
+void light_get_bounds(const Light* light, f32 range, v3* center, f32* radius);
+bool light_overlaps_sphere(const Light* light, f32 range, v3 center, f32 radius);
 
 #endif // _LIGHT_H
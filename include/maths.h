@@ -3,6 +3,12 @@
 #ifndef _MATHS_H
 #define _MATHS_H
 
+// the web build has 128 bit simd when built with -msimd128, next to USE_SSE from common.h for native builds
+#if defined(__wasm_simd128__) && !defined(NO_SIMD)
+  #define USE_SIMD128
+  #include <wasm_simd128.h>
+#endif
+
 #define PI32 3.14159265359f
 
 typedef union v2 {
@@ -10,6 +10,7 @@ typedef struct Mesh {
   u32 normal_index_count;
   u32 uv_count;
   u32 uv_index_count;
+  u32 light_count;
 
   v3* vertex;
   u32* vertex_index;
@@ -17,6 +18,13 @@ typedef struct Mesh {
   u32* normal_index;
   v2* uv;
   u32* uv_index;
+  f32* light; // baked light intensity per vertex index, NULL if the mesh isn't baked
+
+  // bounding sphere in mesh space, computed on first use
+  v3 center;
+  f32 radius;
 } Mesh;
 
+void mesh_compute_bounds(Mesh* mesh);
+
 #endif // _MESH_H
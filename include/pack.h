@@ -0,0 +1,104 @@
+// pack.h
+// binary asset pack, written by the tools and mapped directly into memory by the game
+//
+// layout:
+//   Pack_header
+//   Pack_entry[entry_count]
+//   sections, each aligned to PACK_ALIGNMENT, holding a Pack_mesh or a Pack_texture followed by its arrays
+//
+// offsets within a section are relative to the start of that section, so that the tools can write
+// sections independently and the pack tool only has to concatenate them
+
+#ifndef _PACK_H
+#define _PACK_H
+
+#define PACK_MAGIC      (0x4b434150) // "PACK"
+#define PACK_VERSION    (1)
+#define PACK_ALIGNMENT  (16)
+#define PACK_NAME_SIZE  (32)
+#define PACK_MAX_MIPS   (16)
+
+typedef enum Pack_entry_type {
+  PACK_ENTRY_MESH = 1,
+  PACK_ENTRY_TEXTURE,
+} Pack_entry_type;
+
+typedef struct Pack_header {
+  u32 magic;
+  u32 version;
+  u32 entry_count;
+  u32 size; // of the whole pack in bytes
+} Pack_header;
+
+typedef struct Pack_entry {
+  char name[PACK_NAME_SIZE];
+  u32 type;
+  u32 offset; // of the section from the start of the pack
+  u32 size;
+  u32 _pad;
+} Pack_entry;
+
+typedef struct Pack_mesh {
+  u32 type;
+  u32 vertex_count;
+  u32 vertex_index_count;
+  u32 normal_count;
+  u32 normal_index_count;
+  u32 uv_count;
+  u32 uv_index_count;
+  u32 vertex;
+  u32 vertex_index;
+  u32 normal;
+  u32 normal_index;
+  u32 uv;
+  u32 uv_index;
+  u32 light_count; // baked light per vertex index, written by lightbake. 0 if the mesh isn't baked
+  u32 light;
+  u32 _pad[1];
+} Pack_mesh;
+
+typedef struct Pack_texture_level {
+  u32 width;
+  u32 height;
+  u32 format;
+  u32 flags;
+  u32 width_shift;
+  u32 width_mask;
+  u32 height_mask;
+  u32 block_shift;
+  u32 data;
+  u32 size;
+  u32 _pad[2];
+} Pack_texture_level;
+
+typedef struct Pack_texture {
+  u32 type;
+  u32 level_count; // full resolution level followed by the mip levels
+  u32 palette;     // 0 if the texture isn't palettized
+  u32 _pad;
+  Pack_texture_level levels[];
+} Pack_texture;
+
+typedef struct Pack {
+  const u8* data;
+  u32 size;
+  bool mapped;
+} Pack;
+
+// destination of a named asset, generated into assets.h by the pack tool
+typedef struct Pack_asset {
+  const char* name;
+  Mesh* mesh;
+  Texture* texture;
+  Texture* mips; // storage for PACK_MAX_MIPS levels
+} Pack_asset;
+
+Result pack_open(Pack* pack, const char* path);
+Result pack_from_memory(Pack* pack, const void* data, u32 size);
+void pack_close(Pack* pack);
+const Pack_entry* pack_find(const Pack* pack, const char* name);
+Result pack_get_mesh(const Pack* pack, const Pack_entry* entry, Mesh* mesh);
+Result pack_get_texture(const Pack* pack, const Pack_entry* entry, Texture* texture, Texture* mips);
+Result pack_load_assets(const Pack* pack, Pack_asset* assets, u32 count);
+
+#endif // _PACK_H
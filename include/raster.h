@@ -3,6 +3,8 @@
 #ifndef _RASTER_H
 #define _RASTER_H
 
+Result assets_load(const char* path);
+Result assets_load_from_memory(const void* data, u32 size);
 void init(void);
 i32 raster_main(i32 argc, char** argv);
 void mouse_click(i32 x, i32 y);
@@ -18,8 +18,13 @@ typedef enum Render_target {
 } Render_target;
 
 typedef enum Render_mode {
-  MODE_TEXTURE    = 1 << 0,
-  MODE_DEPTH_TEST = 1 << 1,
+  MODE_TEXTURE        = 1 << 0,
+  MODE_DEPTH_TEST     = 1 << 1,
+  MODE_PIXEL_LIGHTING = 1 << 2, // evaluate lights per pixel rather than per vertex
+  MODE_BAKED_LIGHTING = 1 << 3, // use the light baked into the mesh instead of the lights
+  MODE_VERTEX_LIGHT   = 1 << 4, // Vertex.light already holds the light of the vertex, set by render_mesh for meshes with normals
+  MODE_VERTEX_FOG     = 1 << 5, // blend towards the fog color by Vertex.fog, set by render_mesh with per vertex fog
+  MODE_VERTEX_NORMAL  = 1 << 6, // light per pixel with Vertex.normal interpolated, set by render_mesh for meshes with normals
 } Render_mode;
 
 typedef union Rect {
@@ -74,6 +79,9 @@ typedef struct Vertex {
   v3 p;
   v3 wp;
   v2 uv;
+  f32 light; // baked
+  f32 fog;   // weight of the fog color, with per vertex fog
+  v3 normal; // in world space, with MODE_VERTEX_NORMAL
 } Vertex;
 
 typedef struct Triangle {
@@ -86,6 +94,7 @@ typedef struct Triangle {
 
 void renderer_init(Color* color_buffer, Color* clear_buffer, u32 width, u32 height);
 void renderer_set_blend_mode(Blend mode);
+void renderer_set_render_mode(u32 mode);
 void renderer_set_render_target(Render_target render_target);
 void render_rect(i32 x, i32 y, i32 w, i32 h, Color color);
 void render_fill_rect(i32 x, i32 y, i32 w, i32 h, Color color);
@@ -94,7 +103,7 @@ void render_line(i32 x1, i32 y1, i32 x2, i32 y2, Color color);
 void render_line_3d(v3 p1, v3 p2, Color color);
 void render_fill_triangle(i32 x1, i32 y1, i32 x2, i32 y2, i32 x3, i32 y3, Color color);
 void render_texture_triangle(i32 x1, i32 y1, i32 x2, i32 y2, i32 x3, i32 y3, f32 z1, f32 z2, f32 z3, v2 uv1, v2 uv2, v2 uv3, const Texture* texture, f32 light_contrib);
-void render_triangle_advanced(Vertex a, Vertex b, Vertex c, const Texture* texture, v3 world_normal, v3 world_position, Light light);
+void render_triangle_advanced(Vertex a, Vertex b, Vertex c, const Texture* texture, v3 world_normal, v3 world_position, u32 mode, u64 light_mask);
 void render_fill_circle(i32 x, i32 y, i32 r, Color color);
 void render_fill_circle_3d(v3 pos, f32 r, Color color);
 void render_point_3d(v3 pos, Color color);
@@ -103,21 +112,32 @@ void render_texture_with_mask(Texture* texture, i32 x, i32 y, i32 w, i32 h, Colo
 void render_texture_with_mask_and_tint(Texture* texture, i32 x, i32 y, i32 w, i32 h, Color mask, Color tint);
 void render_texture_3d(Texture* texture, v3 pos, i32 w, i32 h, Color mask, Color tint);
 void render_axis(v3 origin);
-void render_mesh(Mesh* mesh, Texture* texture, v3 position, v3 size, v3 rotation, Light light);
+void render_mesh(Mesh* mesh, Texture* texture, v3 position, v3 size, v3 rotation);
 void render_text(const char* text, size_t length, i32 x, i32 y, f32 size, Color tint);
+i32 renderer_create_overlay(void);
+void renderer_set_overlay_text(i32 index, const char* text, size_t length, i32 x, i32 y, f32 size, Color tint);
 void renderer_set_clear_color(Color color);
 void renderer_begin_frame(f32 dt);
+void renderer_push_light(Light light);
 void renderer_draw(void);
 void renderer_post_process(void);
 void renderer_end_frame(void);
 void renderer_clear(void);
 i32 renderer_get_num_primitives(void);
 i32 renderer_get_num_primitives_culled(void);
+i32 renderer_get_num_fragments(void);
+i32 renderer_get_num_lights(void);
 void renderer_toggle_fog(void);
+void renderer_toggle_vertex_fog(void);
+void renderer_toggle_ambient_occlusion(void);
+void renderer_cycle_low_res_scale(void);
 void renderer_toggle_dither(void);
 void renderer_toggle_depth_test(void);
 void renderer_toggle_render_zbuffer(void);
 void renderer_toggle_render_normal_buffer(void);
 void renderer_toggle_texture_mapping(void);
+void renderer_toggle_bilinear_filtering(void);
+void renderer_toggle_shadow_filtering(void);
+void renderer_toggle_tile_rendering(void);
 
 #endif // _RENDERER_H
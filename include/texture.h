@@ -18,13 +18,51 @@ typedef Color32 Color;
 #define COLOR_RGBA(R, G, B, A) ((Color) { .r = R, .g = G, .b = B, .a = A, })
 #define COLOR_RGB(R, G, B)     ((Color) { .r = R, .g = G, .b = B, .a = 0xff, })
 
+#define TEXTURE_SUBTEXEL_BITS 8 // fraction bits of the fixed point coordinates used for filtering
+
+typedef enum Texture_flag {
+  TEXTURE_POW2 = 1 << 0,     // power of two dimensions, addressed with `width_shift`, `width_mask` and `height_mask`
+  TEXTURE_SWIZZLED = 1 << 1, // texels stored in square blocks of (1 << `block_shift`) texels, blocks in row-major order
+} Texture_flag;
+
+typedef enum Texture_format {
+  TEXTURE_FORMAT_RGBA8 = 0,
+  TEXTURE_FORMAT_PALETTE8, // one byte per texel indexing into a 256 entry `palette`
+  TEXTURE_FORMAT_BC1,      // 4x4 blocks of two RGB565 endpoints and 2 bit interpolation indices, 8 bytes per block
+} Texture_format;
+
 typedef struct Texture {
-  Color* data;
+  union {
+    Color* data;
+    u8* indices; // TEXTURE_FORMAT_PALETTE8
+    u32* blocks; // TEXTURE_FORMAT_BC1, two words per block
+  };
+  Color* palette;
   u32 width;
   u32 height;
+  u32 format;
+  u32 flags;
+  u32 width_shift;
+  u32 width_mask;
+  u32 height_mask;
+  u32 block_shift;
+  u32 mip_count;        // number of levels in `mips`
+  struct Texture* mips; // box filtered levels, each half the size of the previous one
 } Texture;
 
+typedef Color (*Texture_sampler)(const struct Texture* const texture, const u32 x, const u32 y);
+
+u32 texture_swizzled_index(const Texture* const texture, const u32 x, const u32 y);
+u32 texture_texel_index(const Texture* const texture, const u32 x, const u32 y);
 Color texture_get_pixel(const Texture* const texture, const i32 x, const i32 y);
 Color texture_get_pixel_wrapped(const Texture* const texture, const u32 x, const u32 y);
+Color texture_get_pixel_wrapped_pow2(const Texture* const texture, const u32 x, const u32 y);
+Color texture_get_pixel_wrapped_swizzled(const Texture* const texture, const u32 x, const u32 y);
+Color texture_get_pixel_wrapped_pow2_swizzled(const Texture* const texture, const u32 x, const u32 y);
+Color texture_get_pixel_wrapped_palette(const Texture* const texture, const u32 x, const u32 y);
+Color texture_get_pixel_wrapped_bc1(const Texture* const texture, const u32 x, const u32 y);
+Texture_sampler texture_get_sampler(const Texture* const texture);
+Color texture_sample_bilinear(const Texture* const texture, const Texture_sampler sample, const u32 u, const u32 v);
+const Texture* texture_get_mip(const Texture* const texture, f32 texels_per_pixel);
 
 #endif // _TEXTURE_H
@@ -153,8 +153,25 @@ function fullscreen() {
 	}
 }
 
+// copy the asset pack past the end of linear memory, which the module never allocates from itself
+function loadPack(instance, pack) {
+	const memory = instance.exports.memory;
+	const pageSize = 65536;
+	const address = memory.buffer.byteLength;
+	memory.grow(Math.ceil(pack.byteLength / pageSize));
+	new Uint8Array(memory.buffer, address, pack.byteLength).set(pack);
+	return address;
+}
+
 (async function init() {
-	WebAssembly.instantiateStreaming(fetch("raster.wasm"), {
+	const packPath = "data/assets.pack";
+	const pack = fetch(packPath).then(response => {
+		if (!response.ok) {
+			throw new Error(`failed to fetch asset pack \`${packPath}\`: ${response.status} ${response.statusText}`);
+		}
+		return response.arrayBuffer();
+	});
+	return WebAssembly.instantiateStreaming(fetch("raster.wasm"), {
 		env: {
 			write,
 			sinf: Math.sin,
@@ -170,11 +187,15 @@ function fullscreen() {
 			window_toggle_fullscreen: fullscreen
 		}
 	})
-	.then(obj => {
+	.then(async obj => {
 		wasm = obj;
 		const instance = obj.instance;
+		const packData = new Uint8Array(await pack);
+		const packAddress = loadPack(instance, packData);
+		if (!obj.instance.exports.wasm_main(packAddress, packData.byteLength)) {
+			throw new Error(`invalid asset pack \`${packPath}\`, it may be out of date with raster.wasm`);
+		}
 		const memoryView = new Uint8Array(obj.instance.exports.memory.buffer);
-		obj.instance.exports.wasm_main();
 		const displayAddress = instance.exports.display_get_addr();
 		const width = instance.exports.display_get_width();
 		const height = instance.exports.display_get_height();
@@ -7,10 +7,37 @@ Light light_create(v3 pos, f32 strength, f32 radius) {
     .radius = radius,
     .ambience = LIGHT_AMBIENCE,
     .type = LIGHT_POINT,
+    .shadow_size = 0,
+    .direction = V3(0, -1, 0),
+    .cos_inner = -1,
+    .cos_outer = -1,
   };
 }
 
+// the angles are in degrees, from the direction to the edge of each cone
+Light light_create_spot(v3 pos, v3 direction, f32 strength, f32 radius, f32 inner_angle, f32 outer_angle) {
+  Light light = light_create(pos, strength, radius);
+  outer_angle = CLAMP(outer_angle, 1, 89);
+  inner_angle = CLAMP(inner_angle, 0, outer_angle);
+  light.type = LIGHT_SPOT;
+  light.direction = v3_normalize(direction);
+  light.cos_inner = cosf(inner_angle * (PI32 / 180.0f));
+  light.cos_outer = cosf(outer_angle * (PI32 / 180.0f));
+  return light;
+}
+
+// fraction of the light of a spot light that goes towards -to_light (normalized)
+static f32 light_spot_factor(const Light* light, v3 to_light) {
+  const f32 cos_angle = -v3_dot(to_light, light->direction);
+  return CLAMP((cos_angle - light->cos_outer) / MAX(light->cos_inner - light->cos_outer, EPS), 0, 1);
+}
+
 f32 light_calculate_contribution(Light light, v3 pos, v3 normal) {
+  return CLAMP(light_calculate_intensity(light, pos, normal), light.ambience, 1);
+}
+
+// unclamped and never negative, so that the intensities of several lights can be summed before clamping
+f32 light_calculate_intensity(Light light, v3 pos, v3 normal) {
   f32 result = 0;
 
   v3 light_delta = V3_OP(light.pos, pos, -);
@@ -18,7 +45,121 @@ f32 light_calculate_contribution(Light light, v3 pos, v3 normal) {
   f32 distance = v3_length_square(light_delta);
   f32 attenuation = 1.0f / (1.0f + (distance)/(light.radius*light.radius*light.radius));
   result = v3_dot(normal, light_normalized) * attenuation * light.strength;
-  result = CLAMP(result, light.ambience, 1);
+  if (light.type == LIGHT_SPOT) {
+    result *= light_spot_factor(&light, light_normalized);
+  }
+
+  return MAX(result, 0);
+}
+
+// add the intensity of the light at four positions with their normals, given as separate x, y and z arrays, to `intensity`.
+// the direction is normalized with an approximate reciprocal square root, as v3_normalize_fast does.
+// wasm simd has no approximate reciprocals, and divides by the exact square root instead
+void light_accumulate_intensity4(const Light* light, const f32* x, const f32* y, const f32* z, const f32* nx, const f32* ny, const f32* nz, f32* intensity) {
+#ifdef USE_SSE
+  const __m128 dx = _mm_sub_ps(_mm_set1_ps(light->pos.x), _mm_loadu_ps(x));
+  const __m128 dy = _mm_sub_ps(_mm_set1_ps(light->pos.y), _mm_loadu_ps(y));
+  const __m128 dz = _mm_sub_ps(_mm_set1_ps(light->pos.z), _mm_loadu_ps(z));
+  const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+  const __m128 dot = _mm_add_ps(
+    _mm_add_ps(_mm_mul_ps(dx, _mm_loadu_ps(nx)), _mm_mul_ps(dy, _mm_loadu_ps(ny))),
+    _mm_mul_ps(dz, _mm_loadu_ps(nz))
+  );
+  // positions on the light itself have zero distance, and get no contribution rather than a nan
+  const __m128 inv_length = _mm_and_ps(_mm_rsqrt_ps(distance), _mm_cmpgt_ps(distance, _mm_setzero_ps()));
+  const f32 inv_radius = 1.0f / (light->radius * light->radius * light->radius);
+  const __m128 attenuation = _mm_rcp_ps(_mm_add_ps(_mm_set1_ps(1.0f), _mm_mul_ps(distance, _mm_set1_ps(inv_radius))));
+  __m128 result = _mm_mul_ps(_mm_mul_ps(dot, inv_length), _mm_mul_ps(attenuation, _mm_set1_ps(light->strength)));
+  result = _mm_max_ps(result, _mm_setzero_ps());
+  if (light->type == LIGHT_SPOT) {
+    const __m128 cos_angle = _mm_mul_ps(_mm_sub_ps(_mm_setzero_ps(), _mm_add_ps(
+      _mm_add_ps(_mm_mul_ps(dx, _mm_set1_ps(light->direction.x)), _mm_mul_ps(dy, _mm_set1_ps(light->direction.y))),
+      _mm_mul_ps(dz, _mm_set1_ps(light->direction.z))
+    )), inv_length);
+    const f32 inv_span = 1.0f / MAX(light->cos_inner - light->cos_outer, EPS);
+    __m128 factor = _mm_mul_ps(_mm_sub_ps(cos_angle, _mm_set1_ps(light->cos_outer)), _mm_set1_ps(inv_span));
+    factor = _mm_min_ps(_mm_max_ps(factor, _mm_setzero_ps()), _mm_set1_ps(1.0f));
+    result = _mm_mul_ps(result, factor);
+  }
+  _mm_storeu_ps(intensity, _mm_add_ps(_mm_loadu_ps(intensity), result));
+#elif defined(USE_SIMD128)
+  const v128_t zero = wasm_f32x4_splat(0);
+  const v128_t one = wasm_f32x4_splat(1.0f);
+  const v128_t dx = wasm_f32x4_sub(wasm_f32x4_splat(light->pos.x), wasm_v128_load(x));
+  const v128_t dy = wasm_f32x4_sub(wasm_f32x4_splat(light->pos.y), wasm_v128_load(y));
+  const v128_t dz = wasm_f32x4_sub(wasm_f32x4_splat(light->pos.z), wasm_v128_load(z));
+  const v128_t distance = wasm_f32x4_add(wasm_f32x4_add(wasm_f32x4_mul(dx, dx), wasm_f32x4_mul(dy, dy)), wasm_f32x4_mul(dz, dz));
+  const v128_t dot = wasm_f32x4_add(
+    wasm_f32x4_add(wasm_f32x4_mul(dx, wasm_v128_load(nx)), wasm_f32x4_mul(dy, wasm_v128_load(ny))),
+    wasm_f32x4_mul(dz, wasm_v128_load(nz))
+  );
+  // positions on the light itself have zero distance, and get no contribution rather than a nan
+  const v128_t inv_length = wasm_v128_and(wasm_f32x4_div(one, wasm_f32x4_sqrt(distance)), wasm_f32x4_gt(distance, zero));
+  const f32 inv_radius = 1.0f / (light->radius * light->radius * light->radius);
+  const v128_t attenuation = wasm_f32x4_div(one, wasm_f32x4_add(one, wasm_f32x4_mul(distance, wasm_f32x4_splat(inv_radius))));
+  v128_t result = wasm_f32x4_mul(wasm_f32x4_mul(dot, inv_length), wasm_f32x4_mul(attenuation, wasm_f32x4_splat(light->strength)));
+  result = wasm_f32x4_pmax(result, zero);
+  if (light->type == LIGHT_SPOT) {
+    const v128_t cos_angle = wasm_f32x4_mul(wasm_f32x4_neg(wasm_f32x4_add(
+      wasm_f32x4_add(wasm_f32x4_mul(dx, wasm_f32x4_splat(light->direction.x)), wasm_f32x4_mul(dy, wasm_f32x4_splat(light->direction.y))),
+      wasm_f32x4_mul(dz, wasm_f32x4_splat(light->direction.z))
+    )), inv_length);
+    const f32 inv_span = 1.0f / MAX(light->cos_inner - light->cos_outer, EPS);
+    v128_t factor = wasm_f32x4_mul(wasm_f32x4_sub(cos_angle, wasm_f32x4_splat(light->cos_outer)), wasm_f32x4_splat(inv_span));
+    factor = wasm_f32x4_pmin(wasm_f32x4_pmax(factor, zero), one);
+    result = wasm_f32x4_mul(result, factor);
+  }
+  wasm_v128_store(intensity, wasm_f32x4_add(wasm_v128_load(intensity), result));
+#else
+  for (i32 i = 0; i < 4; ++i) {
+    intensity[i] += light_calculate_intensity(*light, V3(x[i], y[i], z[i]), V3(nx[i], ny[i], nz[i]));
+  }
+#endif
+}
+
+// distance beyond which the light contributes less than LIGHT_CUTOFF,
+// from solving strength / (1 + d^2 / r^3) = LIGHT_CUTOFF for d
+f32 light_get_range(Light light) {
+  if (light.strength <= LIGHT_CUTOFF) {
+    return 0;
+  }
+  return square_root(light.radius * light.radius * light.radius * (light.strength / LIGHT_CUTOFF - 1));
+}
+
+// bounding sphere of the lit volume, which for a spot light is the smallest sphere around its cone
+void light_get_bounds(const Light* light, f32 range, v3* center, f32* radius) {
+  if (light->type != LIGHT_SPOT) {
+    *center = light->pos;
+    *radius = range;
+    return;
+  }
+  const f32 sin_outer = square_root(MAX(1 - light->cos_outer * light->cos_outer, 0));
+  if (light->cos_outer < 0.7071068f) {
+    // wider than 45 degrees from the axis, where the sphere around the rim of the cone also holds its apex
+    *center = V3_OP(light->pos, V3_OP1(light->direction, range * light->cos_outer, *), +);
+    *radius = range * sin_outer;
+  }
+  else {
+    const f32 distance = range / (2 * light->cos_outer);
+    *center = V3_OP(light->pos, V3_OP1(light->direction, distance, *), +);
+    *radius = distance;
+  }
+}
 
-  return result;
+// whether the light can reach anything within the sphere. spot lights also test the sphere against their cone
+bool light_overlaps_sphere(const Light* light, f32 range, v3 center, f32 radius) {
+  const v3 d = V3_OP(center, light->pos, -);
+  const f32 distance_square = v3_length_square(d);
+  if (distance_square > (range + radius) * (range + radius)) {
+    return false;
+  }
+  if (light->type != LIGHT_SPOT) {
+    return true;
+  }
+  // distance from the center to the surface of the cone, along its axis and away from it
+  const f32 sin_outer = square_root(MAX(1 - light->cos_outer * light->cos_outer, 0));
+  const f32 along = v3_dot(d, light->direction);
+  const f32 away = square_root(MAX(distance_square - along * along, 0));
+  const f32 cone_distance = light->cos_outer * away - along * sin_outer;
+  return cone_distance <= radius && along >= -radius;
 }
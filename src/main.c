@@ -5,14 +5,22 @@
 #ifndef TARGET_WASM
 
 i32 main(i32 argc, char** argv) {
+  if (assets_load(ASSET_PACK_PATH) != Ok) {
+    return EXIT_FAILURE;
+  }
   init();
   return raster_main(argc, argv);
 }
 
 #else
 
-void wasm_main(void) {
+// the host fetches the asset pack into linear memory before starting, and stops if this returns false
+bool wasm_main(void* pack_data, u32 pack_size) {
+  if (assets_load_from_memory(pack_data, pack_size) != Ok) {
+    return false;
+  }
   init();
+  return true;
 }
 
 #endif
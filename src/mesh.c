@@ -1 +1,22 @@
 // mesh.c
+
+// sphere around the center of the bounding box, which is good enough for culling
+void mesh_compute_bounds(Mesh* mesh) {
+  if (mesh->vertex_count == 0) {
+    return;
+  }
+  v3 min = mesh->vertex[0];
+  v3 max = mesh->vertex[0];
+  for (u32 i = 1; i < mesh->vertex_count; ++i) {
+    const v3 v = mesh->vertex[i];
+    min = V3(MIN(min.x, v.x), MIN(min.y, v.y), MIN(min.z, v.z));
+    max = V3(MAX(max.x, v.x), MAX(max.y, v.y), MAX(max.z, v.z));
+  }
+  mesh->center = V3_OP1(V3_OP(min, max, +), 0.5f, *);
+  mesh->radius = 0;
+  for (u32 i = 0; i < mesh->vertex_count; ++i) {
+    mesh->radius = MAX(mesh->radius, v3_length(V3_OP(mesh->vertex[i], mesh->center, -)));
+  }
+  // non-zero, so that the bounds of a mesh with a single vertex aren't computed again
+  mesh->radius = MAX(mesh->radius, EPS);
+}
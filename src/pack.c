@@ -0,0 +1,299 @@
+// pack.c
+
+#ifndef TARGET_WASM
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
+#endif
+
+#ifndef NO_STDIO
+  #define pack_error(...) fprintf(stderr, __VA_ARGS__)
+#else
+  #define pack_error(...)
+#endif
+
+static bool pack_name_equal(const char* a, const char* b);
+static bool pack_range_valid(const Pack* pack, const Pack_entry* entry, u32 offset, u32 size);
+static bool pack_array_valid(const Pack* pack, const Pack_entry* entry, u32 offset, u32 count, u32 element_size);
+static bool pack_level_valid(const Pack_texture* texture, const Pack_texture_level* level);
+static bool pack_indices_valid(const u32* indices, u32 count, u32 limit);
+
+// map the pack read-only into memory, no part of it is copied or parsed up front
+Result pack_open(Pack* pack, const char* path) {
+#ifndef TARGET_WASM
+  Result result = Ok;
+  void* data = MAP_FAILED;
+  struct stat st;
+  i32 fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    pack_error("pack_open: failed to open asset pack `%s`\n", path);
+    return_defer(Error);
+  }
+  if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(Pack_header)) {
+    pack_error("pack_open: invalid asset pack `%s`\n", path);
+    return_defer(Error);
+  }
+  data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    pack_error("pack_open: failed to map asset pack `%s`\n", path);
+    return_defer(Error);
+  }
+  if (pack_from_memory(pack, data, st.st_size) != Ok) {
+    munmap(data, st.st_size);
+    return_defer(Error);
+  }
+  pack->mapped = true;
+defer:
+  if (fd >= 0) {
+    close(fd);
+  }
+  return result;
+#else
+  (void)pack;
+  (void)path;
+  return Error;
+#endif
+}
+
+// use a pack that is already in memory, such as one fetched into linear memory by the wasm host
+Result pack_from_memory(Pack* pack, const void* data, u32 size) {
+  const Pack_header* header = (const Pack_header*)data;
+  if (size < sizeof(Pack_header) || ((size_t)data % PACK_ALIGNMENT) != 0) {
+    return Error;
+  }
+  if (header->magic != PACK_MAGIC || header->version != PACK_VERSION || header->size > size) {
+    return Error;
+  }
+  // divided rather than multiplied, which could wrap around with a 32 bit size_t
+  if (header->size < sizeof(Pack_header) || header->entry_count > (header->size - sizeof(Pack_header)) / sizeof(Pack_entry)) {
+    return Error;
+  }
+  pack->data = (const u8*)data;
+  pack->size = header->size;
+  pack->mapped = false;
+  return Ok;
+}
+
+void pack_close(Pack* pack) {
+#ifndef TARGET_WASM
+  if (pack->mapped) {
+    munmap((void*)pack->data, pack->size);
+  }
+#endif
+  pack->data = NULL;
+  pack->size = 0;
+  pack->mapped = false;
+}
+
+const Pack_entry* pack_find(const Pack* pack, const char* name) {
+  const Pack_header* header = (const Pack_header*)pack->data;
+  const Pack_entry* entries = (const Pack_entry*)(pack->data + sizeof(Pack_header));
+  for (u32 i = 0; i < header->entry_count; ++i) {
+    if (pack_name_equal(entries[i].name, name)) {
+      return &entries[i];
+    }
+  }
+  return NULL;
+}
+
+Result pack_get_mesh(const Pack* pack, const Pack_entry* entry, Mesh* mesh) {
+  if (entry->type != PACK_ENTRY_MESH || !pack_range_valid(pack, entry, 0, sizeof(Pack_mesh))) {
+    return Error;
+  }
+  const u8* section = pack->data + entry->offset;
+  const Pack_mesh* m = (const Pack_mesh*)section;
+  if (
+    !pack_array_valid(pack, entry, m->vertex, m->vertex_count, sizeof(v3)) ||
+    !pack_array_valid(pack, entry, m->vertex_index, m->vertex_index_count, sizeof(u32)) ||
+    !pack_array_valid(pack, entry, m->normal, m->normal_count, sizeof(v3)) ||
+    !pack_array_valid(pack, entry, m->normal_index, m->normal_index_count, sizeof(u32)) ||
+    !pack_array_valid(pack, entry, m->uv, m->uv_count, sizeof(v2)) ||
+    !pack_array_valid(pack, entry, m->uv_index, m->uv_index_count, sizeof(u32)) ||
+    !pack_array_valid(pack, entry, m->light, m->light_count, sizeof(f32))
+  ) {
+    return Error;
+  }
+  if (m->light_count != 0 && m->light_count != m->vertex_index_count) {
+    return Error;
+  }
+  // whole triangles, with a normal and uv index for each vertex index if there are any
+  if (
+    (m->vertex_index_count % 3) != 0 ||
+    (m->normal_index_count != 0 && m->normal_index_count != m->vertex_index_count) ||
+    (m->uv_index_count != 0 && m->uv_index_count != m->vertex_index_count)
+  ) {
+    return Error;
+  }
+  // the indices are used as they are by the renderer, so they are checked once here
+  if (
+    !pack_indices_valid((const u32*)(section + m->vertex_index), m->vertex_index_count, m->vertex_count) ||
+    !pack_indices_valid((const u32*)(section + m->normal_index), m->normal_index_count, m->normal_count) ||
+    !pack_indices_valid((const u32*)(section + m->uv_index), m->uv_index_count, m->uv_count)
+  ) {
+    return Error;
+  }
+  mesh->vertex_count = m->vertex_count;
+  mesh->vertex_index_count = m->vertex_index_count;
+  mesh->normal_count = m->normal_count;
+  mesh->normal_index_count = m->normal_index_count;
+  mesh->uv_count = m->uv_count;
+  mesh->uv_index_count = m->uv_index_count;
+  mesh->light_count = m->light_count;
+  mesh->vertex = (v3*)(section + m->vertex);
+  mesh->vertex_index = (u32*)(section + m->vertex_index);
+  mesh->normal = (v3*)(section + m->normal);
+  mesh->normal_index = (u32*)(section + m->normal_index);
+  mesh->uv = (v2*)(section + m->uv);
+  mesh->uv_index = (u32*)(section + m->uv_index);
+  mesh->light = m->light_count ? (f32*)(section + m->light) : NULL;
+  return Ok;
+}
+
+// `mips` has to hold PACK_MAX_MIPS levels
+Result pack_get_texture(const Pack* pack, const Pack_entry* entry, Texture* texture, Texture* mips) {
+  if (entry->type != PACK_ENTRY_TEXTURE || !pack_range_valid(pack, entry, 0, sizeof(Pack_texture))) {
+    return Error;
+  }
+  const u8* section = pack->data + entry->offset;
+  const Pack_texture* t = (const Pack_texture*)section;
+  if (t->level_count == 0 || t->level_count > PACK_MAX_MIPS + 1) {
+    return Error;
+  }
+  if (!pack_range_valid(pack, entry, sizeof(Pack_texture), t->level_count * sizeof(Pack_texture_level))) {
+    return Error;
+  }
+  if (t->palette && !pack_range_valid(pack, entry, t->palette, 256 * sizeof(Color))) {
+    return Error;
+  }
+  for (u32 i = 0; i < t->level_count; ++i) {
+    const Pack_texture_level* level = &t->levels[i];
+    if (!pack_range_valid(pack, entry, level->data, level->size) || !pack_level_valid(t, level)) {
+      return Error;
+    }
+    Texture* dest = i == 0 ? texture : &mips[i - 1];
+    *dest = (Texture) {
+      .data = (Color*)(section + level->data),
+      .palette = t->palette ? (Color*)(section + t->palette) : NULL,
+      .width = level->width,
+      .height = level->height,
+      .format = level->format,
+      .flags = level->flags,
+      .width_shift = level->width_shift,
+      .width_mask = level->width_mask,
+      .height_mask = level->height_mask,
+      .block_shift = level->block_shift,
+      .mip_count = 0,
+      .mips = NULL,
+    };
+  }
+  texture->mip_count = t->level_count - 1;
+  texture->mips = t->level_count > 1 ? mips : NULL;
+  return Ok;
+}
+
+Result pack_load_assets(const Pack* pack, Pack_asset* assets, u32 count) {
+  Result result = Ok;
+  for (u32 i = 0; i < count; ++i) {
+    Pack_asset* asset = &assets[i];
+    const Pack_entry* entry = pack_find(pack, asset->name);
+    if (!entry) {
+      pack_error("pack_load_assets: asset `%s` is missing from the pack\n", asset->name);
+      result = Error;
+      continue;
+    }
+    if (asset->mesh && pack_get_mesh(pack, entry, asset->mesh) != Ok) {
+      pack_error("pack_load_assets: invalid mesh `%s`\n", asset->name);
+      result = Error;
+    }
+    if (asset->texture && pack_get_texture(pack, entry, asset->texture, asset->mips) != Ok) {
+      pack_error("pack_load_assets: invalid texture `%s`\n", asset->name);
+      result = Error;
+    }
+  }
+  return result;
+}
+
+bool pack_name_equal(const char* a, const char* b) {
+  for (u32 i = 0; i < PACK_NAME_SIZE; ++i) {
+    if (a[i] != b[i]) {
+      return false;
+    }
+    if (a[i] == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// a range within the section of the entry, which itself has to be within the pack
+bool pack_range_valid(const Pack* pack, const Pack_entry* entry, u32 offset, u32 size) {
+  if (entry->offset > pack->size || entry->size > pack->size - entry->offset) {
+    return false;
+  }
+  return offset <= entry->size && size <= entry->size - offset && ((entry->offset + offset) % 4) == 0;
+}
+
+// count elements from offset, without multiplying the count out, which could wrap around in wasm
+bool pack_array_valid(const Pack* pack, const Pack_entry* entry, u32 offset, u32 count, u32 element_size) {
+  if (!pack_range_valid(pack, entry, offset, 0)) {
+    return false;
+  }
+  return count <= (entry->size - offset) / element_size;
+}
+
+bool pack_indices_valid(const u32* indices, u32 count, u32 limit) {
+  for (u32 i = 0; i < count; ++i) {
+    if (indices[i] >= limit) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// the format, dimensions and addressing fields of a level agree with each other and with the size of its data,
+// so that the samplers never index outside of it
+bool pack_level_valid(const Pack_texture* texture, const Pack_texture_level* level) {
+  const u64 width = level->width;
+  const u64 height = level->height;
+  if (width == 0 || height == 0 || width * height > UINT32_MAX || (level->flags & ~(u32)(TEXTURE_POW2 | TEXTURE_SWIZZLED)) != 0) {
+    return false;
+  }
+  u64 size = 0;
+  switch (level->format) {
+    case TEXTURE_FORMAT_RGBA8:
+      size = width * height * sizeof(Color);
+      break;
+    case TEXTURE_FORMAT_PALETTE8:
+      if (!texture->palette) {
+        return false;
+      }
+      size = width * height;
+      break;
+    case TEXTURE_FORMAT_BC1:
+      if ((width % 4) != 0 || (height % 4) != 0) {
+        return false;
+      }
+      size = (width / 4) * (height / 4) * 8;
+      break;
+    default:
+      return false;
+  }
+  if (level->size < size) {
+    return false;
+  }
+  if (level->flags & TEXTURE_POW2) {
+    if (
+      (width & (width - 1)) != 0 || (height & (height - 1)) != 0 ||
+      level->width_shift >= 32 || (1ull << level->width_shift) != width ||
+      level->width_mask != width - 1 || level->height_mask != height - 1
+    ) {
+      return false;
+    }
+  }
+  if (level->flags & TEXTURE_SWIZZLED) {
+    if (level->block_shift >= 16 || (width % (1u << level->block_shift)) != 0 || (height % (1u << level->block_shift)) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
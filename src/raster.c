@@ -22,6 +22,7 @@
 #include "config.h"
 #include "camera.h"
 #include "mesh.h"
+#include "pack.h"
 #include "assets.h"
 #include "light.h"
 #include "renderer.h"
@@ -32,12 +33,20 @@
 #include "font.c"
 #include "camera.c"
 #include "mesh.c"
+#include "pack.c"
 #include "light.c"
 #include "renderer.c"
 #include "window.c"
 
+#define LIGHT_RING_COUNT 24
+#define SPOT_INNER_ANGLE 25
+#define SPOT_OUTER_ANGLE 40
+
 typedef struct Game {
   Light light;
+  bool light_ring;
+  bool pixel_lighting;
+  bool baked_lighting;
   size_t tick;
   f32 timer;
   f32 time_scale;
@@ -45,10 +54,14 @@ typedef struct Game {
   bool running;
   f32 dt_min;
   f32 dt_max;
+  i32 hud;
 } Game;
 
 Game game = {
   .light = {0},
+  .light_ring = false,
+  .pixel_lighting = true,
+  .baked_lighting = false,
   .tick = 0,
   .timer = 0,
   .time_scale = 1.0f,
@@ -56,11 +69,14 @@ Game game = {
   .running = true,
   .dt_min = 10000,
   .dt_max = 0,
+  .hud = -1,
 };
 
 Color BUFFER[WINDOW_WIDTH * WINDOW_HEIGHT] = {0};
 Color CLEAR_BUFFER[WINDOW_WIDTH * WINDOW_HEIGHT] = {0};
 
+Pack pack = {0};
+
 #ifdef NO_TIMER
 extern i32 time();
 #endif
@@ -68,6 +84,21 @@ extern i32 time();
 const i32 EVENT_TYPE_DOWN = 0;
 const i32 EVENT_TYPE_UP = 1;
 
+// point the meshes and textures declared in assets.h into the mapped pack
+Result assets_load(const char* path) {
+  if (pack_open(&pack, path) != Ok) {
+    return Error;
+  }
+  return pack_load_assets(&pack, pack_assets, LENGTH(pack_assets));
+}
+
+Result assets_load_from_memory(const void* data, u32 size) {
+  if (pack_from_memory(&pack, data, size) != Ok) {
+    return Error;
+  }
+  return pack_load_assets(&pack, pack_assets, LENGTH(pack_assets));
+}
+
 void init(void) {
   input_init();
   random_init(time(0));
@@ -81,6 +112,7 @@ void init(void) {
   game.light = light_create(V3(0, 2.5f, -4.5f), 2.0f, 1.5f);
   game.dt_min = 1;
   game.dt_max = 0;
+  game.hud = renderer_create_overlay();
 }
 
 i32 raster_main(i32 argc, char** argv) {
@@ -103,6 +135,7 @@ i32 raster_main(i32 argc, char** argv) {
       clear_input_events();
     }
   }
+  pack_close(&pack);
 #endif
   return EXIT_SUCCESS;
 }
@@ -160,6 +193,32 @@ void update_and_render(f32 dt) {
   if (input.key_pressed[KEY_T]) {
     renderer_toggle_texture_mapping();
   }
+  if (input.key_pressed[KEY_B]) {
+    renderer_toggle_bilinear_filtering();
+  }
+  if (input.key_pressed[KEY_L]) {
+    game.light_ring = !game.light_ring;
+  }
+  if (input.key_pressed[KEY_P]) {
+    game.pixel_lighting = !game.pixel_lighting;
+  }
+  if (input.key_pressed[KEY_C]) {
+    game.baked_lighting = !game.baked_lighting;
+  }
+  if (input.key_pressed[KEY_O]) {
+    // point down into the room, keeping the rest of the light as it is
+    Light light = game.light.type == LIGHT_SPOT ?
+      light_create(game.light.pos, game.light.strength, game.light.radius) :
+      light_create_spot(game.light.pos, V3(0, -1, 0), game.light.strength, game.light.radius, SPOT_INNER_ANGLE, SPOT_OUTER_ANGLE);
+    light.shadow_size = game.light.shadow_size;
+    game.light = light;
+  }
+  if (input.key_pressed[KEY_H]) {
+    game.light.shadow_size = game.light.shadow_size ? 0 : SHADOW_MAP_SIZE;
+  }
+  if (input.key_pressed[KEY_G]) {
+    renderer_toggle_shadow_filtering();
+  }
   if (input.key_down[KEY_W]) {
     camera.pos = V3_OP(
       camera.pos,
@@ -230,12 +289,24 @@ void update_and_render(f32 dt) {
   if (input.key_down[KEY_K]) {
     game.light.pos.y -= speed * dt;
   }
+  if (input.key_pressed[KEY_5]) {
+    renderer_toggle_tile_rendering();
+  }
   if (input.key_pressed[KEY_6]) {
     renderer_toggle_dither();
   }
   if (input.key_pressed[KEY_7]) {
     renderer_toggle_fog();
   }
+  if (input.key_pressed[KEY_V]) {
+    renderer_toggle_vertex_fog();
+  }
+  if (input.key_pressed[KEY_I]) {
+    renderer_toggle_ambient_occlusion();
+  }
+  if (input.key_pressed[KEY_Y]) {
+    renderer_cycle_low_res_scale();
+  }
   if (input.key_pressed[KEY_8]) {
     renderer_toggle_depth_test();
   }
@@ -257,28 +328,44 @@ void update_and_render(f32 dt) {
   renderer_begin_frame(dt);
   renderer_clear();
 
-  render_mesh(&room_floor, &t_tile_23, V3(0, 0, 0), V3(1, 1, 1), V3(0, 0, 0), game.light);
-  render_mesh(&room, &t_brick_6, V3(0, 0, 0), V3(1, 1, 1), V3(0, 0, 0), game.light);
+  renderer_push_light(game.light);
+  if (game.light_ring) {
+    // small lights circling the cubes, each one only reaching the few screen tiles around it
+    for (i32 i = 0; i < LIGHT_RING_COUNT; ++i) {
+      f32 angle = 2 * PI32 * (i / (f32)LIGHT_RING_COUNT) + game.timer * 0.5f;
+      renderer_push_light(light_create(V3(1 + 3.5f * cosf(angle), 0.15f, -6 + 3.5f * sinf(angle)), 1.0f, 0.3f));
+    }
+  }
+
+  // the room is made of large triangles, where per vertex lighting gets the falloff visibly wrong.
+  // its baked light comes from the light at its initial position, and ignores the rest of the lights
+  renderer_set_render_mode(
+    MODE_TEXTURE | MODE_DEPTH_TEST |
+    (game.pixel_lighting ? MODE_PIXEL_LIGHTING : 0) |
+    (game.baked_lighting ? MODE_BAKED_LIGHTING : 0)
+  );
+  render_mesh(&room_floor, &t_tile_23, V3(0, 0, 0), V3(1, 1, 1), V3(0, 0, 0));
+  render_mesh(&room, &t_brick_6, V3(0, 0, 0), V3(1, 1, 1), V3(0, 0, 0));
+  renderer_set_render_mode(MODE_TEXTURE | MODE_DEPTH_TEST);
   {
     f32 size = 1;
-    render_mesh(&cube, &t_brick_6, V3(0, 1.5f * sinf(game.timer * 0.8f), -6), V3(size, size, size), V3(game.timer * 42, 100 + game.timer * 30, 200 + game.timer * 40), game.light);
+    render_mesh(&cube, &t_brick_6, V3(0, 1.5f * sinf(game.timer * 0.8f), -6), V3(size, size, size), V3(game.timer * 42, 100 + game.timer * 30, 200 + game.timer * 40));
   }
   {
     f32 size = 1;
-    render_mesh(&cube, &t_brick_6, V3(2, sinf(game.timer * 0.8f) - 1.2f, -6), V3(size, size, size), V3(0, 0, 0), game.light);
+    render_mesh(&cube, &t_brick_6, V3(2, sinf(game.timer * 0.8f) - 1.2f, -6), V3(size, size, size), V3(0, 0, 0));
   }
 
   TIMER_START();
   renderer_draw();
   f32 time_to_render = TIMER_END();
   renderer_post_process();
-  {
-    static char text[256] = {0};
-    static size_t length = 0;
-    if ((game.tick % 4) == 0) {
-      length = snprintf(text, sizeof(text), "%.d fps\nprimitives: %d\n%g ms", (i32)(1.0f / dt), renderer_get_num_primitives(), time_to_render * 1000);
-    }
-    render_text(text, length, 2, 2, 1, COLOR_RGB(255, 255, 255));
+  if ((game.tick % 4) == 0) {
+    // the overlay keeps showing the text in between, and is drawn over the frame when it ends
+    char text[256] = {0};
+    i32 fragments = renderer_get_num_fragments();
+    size_t length = snprintf(text, sizeof(text), "%.d fps\nprimitives: %d\n%g ms\n%g ns/pixel\nlights: %d", (i32)(1.0f / dt), renderer_get_num_primitives(), time_to_render * 1000, fragments > 0 ? (time_to_render * 1000000000) / fragments : 0, renderer_get_num_lights());
+    renderer_set_overlay_text(game.hud, text, MIN(length, sizeof(text) - 1), 2, 2, 1, COLOR_RGB(255, 255, 255));
   }
   // render_axis(V3(0, 0, 0));
   // render_texture_3d(&t_sun_icon, game.light.pos, 24, 24, COLOR_RGB(255, 0, 255), COLOR_RGB(255, 255, 100));
@@ -6,11 +6,58 @@
 // #define NO_TEXTURES
 // #define NO_RENDER_COMMANDS
 // #define NO_NORMAL_BUFFER
+// #define TILED_FRAMEBUFFER
 
 #define BB_COLOR COLOR_RGBA(255, 255, 255, 150)
 
 #define MAX_RENDER_COMMANDS (1024*4)
 #define MAX_RENDER_TEXTURES (8)
+#define MAX_LIGHTS (64) // one bit per light in the tile light masks
+#define MAX_DRAWS (256)
+#define VERTEX_CACHE_SIZE (4096) // power of two
+#define POST_PROCESS_SPAN (64) // pixels of a row that the effects are applied to at a time, multiple of four
+#define BLEND_BITS (8)
+#define BLEND_ONE (1 << BLEND_BITS)
+#define FOG_LUT_BITS (12)
+#define FOG_LUT_SIZE (1 << FOG_LUT_BITS)
+#define DITHER_MAX_SIZE (8) // of the bayer matrix, smaller matrices are repeated to fill the table
+#define DITHER_MASK (DITHER_MAX_SIZE - 1)
+#define LOW_RES_DEPTH_TOLERANCE (0.01f) // relative depth difference at which a low resolution sample counts half when upsampling
+#define AMBIENT_OCCLUSION_PAIRS (4)
+#define AMBIENT_OCCLUSION_MAX_PIXELS (24) // radius of the samples on screen
+#define GLYPH_CACHE_SIZE (4) // text sizes that the glyphs are kept expanded for at once
+#define MAX_GLYPHS (128)
+#define MAX_GLYPH_HEIGHT (16)
+#define MAX_GLYPH_WIDTH (64) // in pixels after expanding to the text size, a bit per pixel
+#define MAX_OVERLAYS (16)
+#define MAX_OVERLAY_TEXT (256)
+#define OVERLAY_HEIGHT (64) // in pixels, text below it is cut off
+#define OVERLAY_WORDS ((RASTER_WIDTH + 63) / 64) // 64 pixel words of an overlay row
+#define VERTEX_CACHE_NO_LIGHT (0xffffffff)
+#define MAX_SHADOW_MAPS (4)
+#define MAX_SHADOW_MAP_SIZE (SHADOW_MAP_SIZE)
+#define MAX_SHADOW_TEXELS (SHADOW_CUBE_FACES * MAX_SHADOW_MAP_SIZE * MAX_SHADOW_MAP_SIZE) // room for one cube map, or a spot light map per shadow map
+#define MAX_SHADOW_CLIP_VERTICES (9)
+#define SHADOW_CUBE_FACES (6)
+
+// screen tiles, used by the tile renderer and for light culling
+#define TILES_X ((RASTER_WIDTH + TILE_SIZE - 1) / TILE_SIZE)
+#define TILES_Y ((RASTER_HEIGHT + TILE_SIZE - 1) / TILE_SIZE)
+#define MAX_TILES (TILES_X * TILES_Y)
+
+#ifdef TILED_FRAMEBUFFER
+  // render targets are stored as 8x8 pixel blocks (64 contiguous pixels each),
+  // and resolved into linear row-major order when the frame is presented
+  #define FB_BLOCK_SIZE_LOG2 (3)
+  #define FB_BLOCK_SIZE (1 << FB_BLOCK_SIZE_LOG2)
+  #define FB_BLOCK_MASK (FB_BLOCK_SIZE - 1)
+  #define FB_BLOCK_AREA (FB_BLOCK_SIZE * FB_BLOCK_SIZE)
+#endif
+
+// full screen passes are split into bands of whole rows, which are processed in parallel.
+// a band is about this many pixels, so that the part of each buffer that a pass touches (64 KiB of a 32 bit buffer)
+// stays in the cache of the thread that processes it
+#define BAND_PIXELS (16 * 1024)
 
 #ifndef NO_RENDER_COMMANDS
 typedef enum Render_command_type {
@@ -34,17 +81,133 @@ typedef struct Render_command {
       v3 world_normal;
       v3 world_position;
       Texture texture;
-      Light light;
+      u32 mode; // Render_mode flags of the draw
+      u64 light_mask; // lights that reach the triangle
     } prim;
   };
 } __attribute__((aligned(CACHELINESIZE))) Render_command;
 
+// tile renderer: triangles are binned per screen tile, and every tile is rasterized and post processed
+// in tile-local storage before it is written to the framebuffer
+#define TILE_APRON (1) // border shared with neighbouring tiles, so that edge detection can sample across tile edges
+#define TILE_STRIDE (TILE_SIZE + 2 * TILE_APRON)
+#define MAX_TILE_BIN_ENTRIES (MAX_RENDER_COMMANDS * 8)
+
+typedef struct Tile {
+  Color color[TILE_STRIDE * TILE_STRIDE];
+  f32 zbuffer[TILE_STRIDE * TILE_STRIDE];
+#ifndef NO_NORMAL_BUFFER
+  Color normal_buffer[TILE_STRIDE * TILE_STRIDE];
+#endif
+} Tile;
+
+#endif
+
+#define PIXEL_BATCH_SIZE (4)
+
+// covered pixels of a triangle that are lit together by the per-pixel lighting path, world positions and normals are stored per axis
+typedef struct Pixel_batch {
+  f32 x[PIXEL_BATCH_SIZE];
+  f32 y[PIXEL_BATCH_SIZE];
+  f32 z[PIXEL_BATCH_SIZE];
+  f32 nx[PIXEL_BATCH_SIZE];
+  f32 ny[PIXEL_BATCH_SIZE];
+  f32 nz[PIXEL_BATCH_SIZE];
+  Color texel[PIXEL_BATCH_SIZE];
+  u16 fog[PIXEL_BATCH_SIZE];
+  Color* target[PIXEL_BATCH_SIZE];
+  i32 count;
+} Pixel_batch;
+
+// mesh drawn this frame, replayed into the shadow maps
+typedef struct Draw {
+  Mesh* mesh;
+  m4 model;
+} Draw;
+
+// screen space effects that are done at a lower resolution, and upsampled when they are blended into the framebuffer
+typedef enum Low_res_effect {
+  LOW_RES_EDGE_DETECTION,
+  LOW_RES_AMBIENT_OCCLUSION,
+
+  MAX_LOW_RES_EFFECT,
+} Low_res_effect;
+
+// color that a span of pixels is blended towards, with a fixed point weight per pixel (BLEND_ONE is fully the color)
+typedef struct Blend_layer {
+  const u16* weights;
+  Color color;
+} Blend_layer;
+
+// the glyphs of a font expanded horizontally to a text size, as 1-bit masks of each row (the lowest bit being the leftmost pixel).
+// rows are repeated vertically while they are drawn
+typedef struct Glyph_masks {
+  const u8* glyphs; // of the font that the masks were built from, NULL if unused
+  f32 size;
+  i32 width;
+  u64 rows[MAX_GLYPHS][MAX_GLYPH_HEIGHT];
+} Glyph_masks;
+
+// text that is kept on screen over several frames. it is rasterized into 1-bit row masks when the text changes,
+// and the masks are drawn over every frame when it ends
+typedef struct Overlay {
+  char text[MAX_OVERLAY_TEXT];
+  size_t length;
+  i32 x;
+  i32 y;
+  f32 size;
+  Color tint;
+  bool dirty;  // text changed since the masks were built
+  bool masked; // rasterized into the masks, otherwise drawn with render_text every frame
+  i32 width;   // of the set bits, from x and y
+  i32 height;
+  u64 rows[OVERLAY_HEIGHT][OVERLAY_WORDS];
+} Overlay;
+
+// transformed and lit mesh vertex, shared by the triangles of a draw that use it. the cache is direct mapped on the
+// vertex index, so meshes with more vertices than it holds only lose part of the sharing
+typedef struct Vertex_cache_entry {
+  v3 world;
+  v3 clip;
+  u32 draw; // stamp of the draw that the entry belongs to
+  u32 vertex_index;
+  u32 normal_index; // that the normal and light were computed with, VERTEX_CACHE_NO_LIGHT if they haven't been
+  v3 normal;        // in world space
+  f32 light;
+} Vertex_cache_entry;
+
+// distance to the nearest shadow casters around a light, one face per axis direction. spot lights only need a single face
+// along their direction
+typedef struct Shadow_map {
+  f32* depth; // faces of size * size texels holding 1/w, so that it can be interpolated linearly in screen space. 0 where nothing was drawn
+  i32 size;
+  i32 face_count;
+  u32 light_index;
+  m4 face_vp[SHADOW_CUBE_FACES];
+} Shadow_map;
+
+// set of buffers that triangles are rasterized into, either the full framebuffer or a tile
+typedef struct Raster_target {
+  Color* color;
+  f32* zbuffer;
+#ifndef NO_NORMAL_BUFFER
+  Color* normal_buffer;
+#endif
+  Rect bounds; // screen space region covered by the buffers (x1, y1, x2, y2)
+  i32 stride;
+#ifdef TILED_FRAMEBUFFER
+  bool tiled; // addressed with pixel_index
 #endif
+} Raster_target;
 
 typedef struct Renderer {
   Color* target;
   Color* color_buffer;
   Color* clear_buffer;
+  Color* display_buffer; // linear buffer handed to the platform layer
+#ifdef TILED_FRAMEBUFFER
+  Color tiled_color_buffer[RASTER_WIDTH * RASTER_HEIGHT];
+#endif
   f32* zbuffer_target;
   f32 zbuffer[RASTER_WIDTH * RASTER_HEIGHT];
   f32 clear_zbuffer[RASTER_WIDTH * RASTER_HEIGHT];
@@ -53,27 +216,72 @@ typedef struct Renderer {
   i32 width;
   i32 height;
   Blend blend_mode;
+  u32 mode; // Render_mode flags for the following draws
   bool dither;
+  u32 dither_bias[DITHER_MAX_SIZE][DITHER_MAX_SIZE]; // per channel bias added before quantizing the pixel at (x & DITHER_MASK, y & DITHER_MASK)
+  Color dither_mask; // bits that are kept of each channel
+  u8 dither_bits[3]; // that the table was built with
+  u16 dither_repeat[3]; // the high half of the product of a quantized channel with this is its kept bits repeated below them
+  i32 dither_size;
   bool fog;
+  bool vertex_fog;
+  u16 fog_lut[FOG_LUT_SIZE + 1]; // fog blend weight by quantized depth
+  f32 fog_lut_density; // that the table was built with
   bool edge_detection;
+  bool edge_detection_depth;
+  bool edge_detection_low_res;
+  bool ambient_occlusion;
+  i32 low_res_scale; // the low resolution effects are done at one sample per low_res_scale x low_res_scale pixels
+  i32 low_res_width;
+  i32 low_res_height;
+  f32 low_res_depth[RASTER_WIDTH * RASTER_HEIGHT]; // view space depth of the pixel that each sample was taken at
+  u16 low_res_weights[MAX_LOW_RES_EFFECT][RASTER_WIDTH * RASTER_HEIGHT]; // blend weight of each effect and sample
   bool render_zbuffer;
   bool render_normal_buffer;
   i32 num_primitives;         // triangles drawn
   i32 num_primitives_culled;  // triangles culled
+  i32 num_fragments;          // pixels shaded by the triangle rasterizer
   f32 dt;
   bool depth_test;
   bool texture_mapping;
+  bool bilinear_filtering;
+  bool tile_rendering;
+  bool clear_pending;   // clear deferred to the tile renderer
+  bool post_processed;  // post processing already done by the tile renderer
+  Light lights[MAX_LIGHTS];
+  f32 light_range[MAX_LIGHTS];
+  u32 light_count;
+  u64 light_tile_mask[MAX_TILES]; // bit i is set if light i reaches the tile
+  f32 ambience;
+  i8 light_shadow_map[MAX_LIGHTS]; // index of the shadow map of the light, -1 if it has none
+  Shadow_map shadow_maps[MAX_SHADOW_MAPS];
+  u32 shadow_map_count;
+  u32 shadow_texel_count;
+  f32 shadow_texels[MAX_SHADOW_TEXELS];
+  bool shadow_filtering;
+  Draw draws[MAX_DRAWS];
+  u32 draw_count;
+  Vertex_cache_entry vertex_cache[VERTEX_CACHE_SIZE];
+  u32 draw_stamp;
+  Glyph_masks glyph_cache[GLYPH_CACHE_SIZE];
+  u32 glyph_cache_next; // entry that is replaced next
+  Overlay overlays[MAX_OVERLAYS];
+  u32 overlay_count;
 
 #ifndef NO_RENDER_COMMANDS
   Render_command render_commands[MAX_RENDER_COMMANDS];
   size_t render_command_count;
   Texture textures[MAX_RENDER_TEXTURES];
   size_t render_texture_count;
+  u16 tile_bin[MAX_TILE_BIN_ENTRIES]; // render command indices, grouped by tile
+  u32 tile_bin_offset[MAX_TILES + 1];
 #endif
 } Renderer;
 
 static Renderer renderer;
 
+static i32 pixel_index(i32 x, i32 y);
+static i32 pixel_index_next(i32 index, i32 x);
 static Color* get_pixel_addr(i32 x, i32 y);
 static Color* get_pixel_addr_from_buffer(Color* buffer, i32 x, i32 y);
 static Color* get_pixel_addr_bounds_checked(Color* buffer, i32 x, i32 y);
@@ -92,30 +300,96 @@ static v2 v2_cartesian(v2 a, v2 b, v2 c, f32 w1, f32 w2, f32 w3);
 static bool degenerate(i32 x1, i32 y1, i32 x2, i32 y2, i32 x3, i32 y3);
 static u8 trivial_reject(f32 x, f32 y, const f32 x_min, const f32 x_max, const f32 y_min, const f32 y_max);
 static i32 clip_vertices(Vertex* input, Vertex* output, i32 count, v3 plane_pos, v3 plane_normal);
+static Raster_target main_raster_target(void);
+static i32 target_index(const Raster_target* rt, i32 x, i32 y);
+static i32 target_index_next(const Raster_target* rt, i32 index, i32 x);
+static bool rasterize_triangle(const Raster_target* rt, Vertex a, Vertex b, Vertex c, const Texture* texture, v3 world_normal, v3 world_position, u32 mode, u64 light_mask);
+static void pixel_batch_flush(Pixel_batch* batch, const u8* lights, u32 light_count);
+static void shadow_map_create(u32 light_index, const Light* light, f32 range);
+static void render_shadow_maps(void);
+static void render_shadow_face(const Shadow_map* map, i32 face);
+static void rasterize_depth(f32* depth, i32 size, v3 a, v3 b, v3 c);
+static f32 shadow_visibility(const Shadow_map* map, v3 pos);
+static bool sphere_screen_rect(v3 center, f32 radius, Rect* rect);
+static u64 light_mask_rect(Rect rect);
+static u64 light_mask_sphere(u64 mask, v3 center, f32 radius);
+static Vertex_cache_entry* vertex_cache_fetch(const Mesh* mesh, u32 vertex_index, m4 model, m4 mvp);
+static f32 vertex_light(u64 light_mask, v3 pos, v3 normal);
+static void post_process_rect(const Raster_target* rt, Rect rect);
+static u16 edge_weight(const Raster_target* rt, i32 x, i32 y, i32 index);
+static u16 depth_edge_weight(const Raster_target* rt, i32 x, i32 y, f32 z);
+static f32 linear_depth(f32 z);
+static u16 ambient_occlusion_weight(const Raster_target* rt, i32 x, i32 y, f32 z);
+static u32 low_res_effects(void);
+static Color low_res_effect_color(i32 effect);
+static void low_res_render(const Raster_target* rt, u32 effects);
+static void low_res_upsample(const Raster_target* rt, i32 x1, i32 y, i32 count, const i32* indices, u32 effects, u16 weights[MAX_LOW_RES_EFFECT][POST_PROCESS_SPAN]);
+static void fog_lut_build(f32 density);
+static void dither_build(i32 size, const u8* bits);
+static void dither_span(Color* colors, i32 count, i32 x, i32 y);
+static u16 fog_at_depth(f32 z);
+static Color clear_color_at(i32 index);
+static Color color_blend(Color color, Color target, u32 weight);
+static void color_blend_span(Color* colors, i32 count, const Blend_layer* layers, i32 layer_count);
+static void clear_buffers(void);
+static const Glyph_masks* glyph_masks_get(const Font* font, f32 size);
+static void render_row_mask(i32 x, i32 y, u64 mask, Color color);
+static Color text_color(Color tint);
+static void overlay_rasterize(Overlay* overlay);
+static void overlays_composite(void);
+static i32 band_height(void);
+static i32 band_count(void);
+static Rect band_rect(i32 band);
+#ifdef TILED_FRAMEBUFFER
+static void resolve_framebuffer(Color* dest, const Color* source);
+#endif
 
 #ifndef NO_RENDER_COMMANDS
 static void push_render_command(const Render_command* cmd);
 static void push_render_command_simple(Render_command_type cmd_type);
 static void process_render_commands(void);
+static bool bin_render_commands(void);
+static void render_tile(i32 tile_x, i32 tile_y);
+static void render_tiles(void);
 #endif // NO_RENDER_COMMANDS
 
+// offset of pixel (x, y) in any of the render targets (color, clear, z and normal buffers)
+inline i32 pixel_index(i32 x, i32 y) {
+#ifdef TILED_FRAMEBUFFER
+  i32 block = (y >> FB_BLOCK_SIZE_LOG2) * (renderer.width >> FB_BLOCK_SIZE_LOG2) + (x >> FB_BLOCK_SIZE_LOG2);
+  return (block * FB_BLOCK_AREA) + ((y & FB_BLOCK_MASK) << FB_BLOCK_SIZE_LOG2) + (x & FB_BLOCK_MASK);
+#else
+  return y * renderer.width + x;
+#endif
+}
+
+// offset of pixel (x + 1, y), given the offset of pixel (x, y)
+inline i32 pixel_index_next(i32 index, i32 x) {
+#ifdef TILED_FRAMEBUFFER
+  // stepping out of a block lands on the same row in the next block
+  return index + 1 + (((x + 1) & FB_BLOCK_MASK) == 0) * (FB_BLOCK_AREA - FB_BLOCK_SIZE);
+#else
+  return index + 1;
+#endif
+}
+
 inline Color* get_pixel_addr(i32 x, i32 y) {
 #ifndef DEBUG_OUT_OF_BOUNDS
   ASSERT(x >= 0 && x < renderer.width && y >= 0 && y < renderer.height);
 #endif
-  return &renderer.target[y * renderer.width + x];
+  return &renderer.target[pixel_index(x, y)];
 }
 
 inline Color* get_pixel_addr_from_buffer(Color* buffer, i32 x, i32 y) {
 #ifndef DEBUG_OUT_OF_BOUNDS
   ASSERT(x >= 0 && x < renderer.width && y >= 0 && y < renderer.height);
 #endif
-  return &buffer[y * renderer.width + x];
+  return &buffer[pixel_index(x, y)];
 }
 
 Color* get_pixel_addr_bounds_checked(Color* buffer, i32 x, i32 y) {
   if (x >= 0 && x < renderer.width && y >= 0 && y < renderer.height) {
-    return &buffer[y * renderer.width + x];
+    return &buffer[pixel_index(x, y)];
   }
   return NULL;
 }
@@ -141,19 +415,19 @@ inline f32* get_zbuffer_addr(i32 x, i32 y) {
 #ifndef DEBUG_OUT_OF_BOUNDS
   ASSERT(x >= 0 && x < renderer.width && y >= 0 && y < renderer.height);
 #endif
-  return &renderer.zbuffer_target[y * renderer.width + x];
+  return &renderer.zbuffer_target[pixel_index(x, y)];
 }
 
 inline f32 get_zbuffer_value(i32 x, i32 y) {
 #ifndef DEBUG_OUT_OF_BOUNDS
   ASSERT(x >= 0 && x < renderer.width && y >= 0 && y < renderer.height);
 #endif
-  return renderer.zbuffer_target[y * renderer.width + x];
+  return renderer.zbuffer_target[pixel_index(x, y)];
 }
 
 f32 get_zbuffer_value_bounds_checked(i32 x, i32 y, f32 out_of_bounds_value) {
   if (x >= 0 && x < renderer.width && y >= 0 && y < renderer.height) {
-    return renderer.zbuffer_target[y * renderer.width + x];
+    return renderer.zbuffer_target[pixel_index(x, y)];
   }
   return out_of_bounds_value;
 }
@@ -278,6 +552,9 @@ i32 clip_vertices(Vertex* input, Vertex* output, i32 count, v3 plane_pos, v3 pla
     c.p  = v3_lerp(a.p, b.p, t);
     c.wp = v3_lerp(a.wp, b.wp, t);
     c.uv = v2_lerp(a.uv, b.uv, t);
+    c.light = f32_lerp(a.light, b.light, t);
+    c.fog = f32_lerp(a.fog, b.fog, t);
+    c.normal = v3_lerp(a.normal, b.normal, t);
 
     if (!point_behind_plane(b.p, plane)) { // b inside
       if (point_behind_plane(a.p, plane)) { // a outside
@@ -293,6 +570,387 @@ i32 clip_vertices(Vertex* input, Vertex* output, i32 count, v3 plane_pos, v3 pla
   return output_count;
 }
 
+inline Raster_target main_raster_target(void) {
+  return (Raster_target) {
+    .color = renderer.target,
+    .zbuffer = renderer.zbuffer_target,
+#ifndef NO_NORMAL_BUFFER
+    .normal_buffer = renderer.normal_buffer,
+#endif
+    .bounds = (Rect) { .x1 = 0, .y1 = 0, .x2 = renderer.width, .y2 = renderer.height, },
+    .stride = renderer.width,
+#ifdef TILED_FRAMEBUFFER
+    .tiled = true,
+#endif
+  };
+}
+
+inline i32 target_index(const Raster_target* rt, i32 x, i32 y) {
+#ifdef TILED_FRAMEBUFFER
+  if (rt->tiled) {
+    return pixel_index(x, y);
+  }
+#endif
+  return (y - rt->bounds.y1) * rt->stride + (x - rt->bounds.x1);
+}
+
+inline i32 target_index_next(const Raster_target* rt, i32 index, i32 x) {
+#ifdef TILED_FRAMEBUFFER
+  if (rt->tiled) {
+    return pixel_index_next(index, x);
+  }
+#endif
+  return index + 1;
+}
+
+#ifdef TILED_FRAMEBUFFER
+// each row of blocks is resolved on its own, in parallel
+void resolve_framebuffer(Color* dest, const Color* source) {
+  const i32 blocks_per_row = renderer.width >> FB_BLOCK_SIZE_LOG2;
+  const i32 blocks_per_column = renderer.height >> FB_BLOCK_SIZE_LOG2;
+  i32 by = 0;
+
+  #pragma omp parallel for
+  for (by = 0; by < blocks_per_column; ++by) {
+    const Color* block = &source[by * blocks_per_row * FB_BLOCK_AREA];
+    for (i32 bx = 0; bx < blocks_per_row; ++bx, block += FB_BLOCK_AREA) {
+      Color* row = &dest[(by * FB_BLOCK_SIZE) * renderer.width + bx * FB_BLOCK_SIZE];
+      for (i32 y = 0; y < FB_BLOCK_SIZE; ++y, row += renderer.width) {
+        memcpy(row, &block[y * FB_BLOCK_SIZE], sizeof(Color) * FB_BLOCK_SIZE);
+      }
+    }
+  }
+}
+#endif
+
+// rows per band, whole rows of blocks with the tiled framebuffer.
+// either way, the pixels of a band are contiguous in all of the render targets, from pixel_index(0, y1) to pixel_index(0, y2)
+inline i32 band_height(void) {
+  i32 height = MAX(1, BAND_PIXELS / renderer.width);
+#ifdef TILED_FRAMEBUFFER
+  height = MAX(FB_BLOCK_SIZE, height & ~FB_BLOCK_MASK);
+#endif
+  return height;
+}
+
+inline i32 band_count(void) {
+  const i32 height = band_height();
+  return (renderer.height + height - 1) / height;
+}
+
+inline Rect band_rect(i32 band) {
+  const i32 height = band_height();
+  return (Rect) { .x1 = 0, .y1 = band * height, .x2 = renderer.width, .y2 = MIN((band + 1) * height, renderer.height), };
+}
+
+// conservative screen space bounds of a sphere, from the projected corners of its bounding box.
+// returns false if the sphere is entirely behind the camera or outside of the screen
+bool sphere_screen_rect(v3 center, f32 radius, Rect* rect) {
+  const m4 vp = m4_multiply(projection, view);
+  f32 x1 = renderer.width;
+  f32 y1 = renderer.height;
+  f32 x2 = 0;
+  f32 y2 = 0;
+  i32 behind = 0;
+  for (i32 i = 0; i < 8; ++i) {
+    v3 corner = V3(
+      center.x + ((i & 1) ? radius : -radius),
+      center.y + ((i & 2) ? radius : -radius),
+      center.z + ((i & 4) ? radius : -radius)
+    );
+    v3 p = m4_multiply_v3(vp, corner);
+    if (p.w < EPS) {
+      behind += 1;
+      continue;
+    }
+    p = project_to_screen(v3_div_scalar(p, p.w), renderer.width, renderer.height);
+    x1 = MIN(x1, p.x);
+    y1 = MIN(y1, p.y);
+    x2 = MAX(x2, p.x);
+    y2 = MAX(y2, p.y);
+  }
+  if (behind == 8) {
+    return false;
+  }
+  if (behind > 0) {
+    // the box crosses the camera plane, so its projection is unbounded
+    *rect = (Rect) { .x1 = 0, .y1 = 0, .x2 = renderer.width, .y2 = renderer.height, };
+    return true;
+  }
+  rect->x1 = MAX((i32)x1, 0);
+  rect->y1 = MAX((i32)y1, 0);
+  rect->x2 = MIN((i32)x2 + 1, renderer.width);
+  rect->y2 = MIN((i32)y2 + 1, renderer.height);
+  return rect->x2 > rect->x1 && rect->y2 > rect->y1;
+}
+
+// lights that reach any of the screen tiles overlapped by the rect
+u64 light_mask_rect(Rect rect) {
+  const i32 tiles_x = (renderer.width + TILE_SIZE - 1) / TILE_SIZE;
+  const i32 tx1 = MAX(rect.x1, 0) / TILE_SIZE;
+  const i32 ty1 = MAX(rect.y1, 0) / TILE_SIZE;
+  const i32 tx2 = MIN(rect.x2 - 1, renderer.width - 1) / TILE_SIZE;
+  const i32 ty2 = MIN(rect.y2 - 1, renderer.height - 1) / TILE_SIZE;
+  u64 mask = 0;
+  for (i32 ty = ty1; ty <= ty2; ++ty) {
+    for (i32 tx = tx1; tx <= tx2; ++tx) {
+      mask |= renderer.light_tile_mask[ty * tiles_x + tx];
+    }
+  }
+  return mask;
+}
+
+// the lights of `mask` whose range, and cone for spot lights, reaches into the sphere
+u64 light_mask_sphere(u64 mask, v3 center, f32 radius) {
+  u64 result = 0;
+  while (mask) {
+    const u32 light_index = __builtin_ctzll(mask);
+    mask &= mask - 1;
+    if (light_overlaps_sphere(&renderer.lights[light_index], renderer.light_range[light_index], center, radius)) {
+      result |= (u64)1 << light_index;
+    }
+  }
+  return result;
+}
+
+Vertex_cache_entry* vertex_cache_fetch(const Mesh* mesh, u32 vertex_index, m4 model, m4 mvp) {
+  Vertex_cache_entry* entry = &renderer.vertex_cache[vertex_index & (VERTEX_CACHE_SIZE - 1)];
+  if (entry->draw != renderer.draw_stamp || entry->vertex_index != vertex_index) {
+    const v3 v = mesh->vertex[vertex_index];
+    entry->world = m4_multiply_v3(model, v);
+    entry->clip = m4_multiply_v3(mvp, v);
+    entry->draw = renderer.draw_stamp;
+    entry->vertex_index = vertex_index;
+    entry->normal_index = VERTEX_CACHE_NO_LIGHT;
+  }
+  return entry;
+}
+
+// unclamped sum of the lights of the mask at pos, skipping the lights that are out of range or behind the surface
+f32 vertex_light(u64 light_mask, v3 pos, v3 normal) {
+  f32 result = 0;
+  while (light_mask) {
+    const u32 light_index = __builtin_ctzll(light_mask);
+    const Light* light = &renderer.lights[light_index];
+    const v3 d = V3_OP(light->pos, pos, -);
+    const f32 range = renderer.light_range[light_index];
+    light_mask &= light_mask - 1;
+    if (v3_dot(d, normal) > 0 && v3_length_square(d) <= range * range) {
+      result += light_calculate_intensity(*light, pos, normal);
+    }
+  }
+  return result;
+}
+
+// reserve a cube shadow map for the light, or a single face one for a spot light, if there is room left for one of its size this frame
+void shadow_map_create(u32 light_index, const Light* light, f32 range) {
+  const v3 directions[SHADOW_CUBE_FACES] = {
+    V3(1, 0, 0), V3(-1, 0, 0), V3(0, 1, 0), V3(0, -1, 0), V3(0, 0, 1), V3(0, 0, -1),
+  };
+  const v3 ups[SHADOW_CUBE_FACES] = {
+    V3(0, 1, 0), V3(0, 1, 0), V3(0, 0, -1), V3(0, 0, 1), V3(0, 1, 0), V3(0, 1, 0),
+  };
+  const i32 size = MIN(light->shadow_size, MAX_SHADOW_MAP_SIZE);
+  const i32 face_count = light->type == LIGHT_SPOT ? 1 : SHADOW_CUBE_FACES;
+  const u32 texel_count = face_count * size * size;
+  if (renderer.shadow_map_count >= MAX_SHADOW_MAPS || renderer.shadow_texel_count + texel_count > MAX_SHADOW_TEXELS) {
+    return;
+  }
+  Shadow_map* map = &renderer.shadow_maps[renderer.shadow_map_count];
+  map->depth = &renderer.shadow_texels[renderer.shadow_texel_count];
+  map->size = size;
+  map->face_count = face_count;
+  map->light_index = light_index;
+  if (light->type == LIGHT_SPOT) {
+    // the outer cone fits within the field of view, which is below 180 degrees as the cone is
+    const f32 fov = 2 * acosf(light->cos_outer) * (180.0f / PI32) + 1;
+    const v3 up = ABS(f32, light->direction.y) > 0.99f ? V3(0, 0, 1) : V3(0, 1, 0);
+    const m4 spot_projection = perspective(fov, 1, SHADOW_NEAR, MAX(range, SHADOW_NEAR * 2));
+    map->face_vp[0] = m4_multiply(spot_projection, look_at(light->pos, V3_OP(light->pos, light->direction, +), up));
+  }
+  else {
+    const m4 face_projection = perspective(90, 1, SHADOW_NEAR, MAX(range, SHADOW_NEAR * 2));
+    for (i32 face = 0; face < SHADOW_CUBE_FACES; ++face) {
+      map->face_vp[face] = m4_multiply(face_projection, look_at(light->pos, V3_OP(light->pos, directions[face], +), ups[face]));
+    }
+  }
+  renderer.light_shadow_map[light_index] = renderer.shadow_map_count++;
+  renderer.shadow_texel_count += texel_count;
+}
+
+// the faces of all shadow maps are independent of each other, and are rendered in parallel
+void render_shadow_maps(void) {
+  const i32 face_count = renderer.shadow_map_count * SHADOW_CUBE_FACES;
+  i32 i = 0;
+
+  #pragma omp parallel for
+  for (i = 0; i < face_count; ++i) {
+    const Shadow_map* map = &renderer.shadow_maps[i / SHADOW_CUBE_FACES];
+    if (i % SHADOW_CUBE_FACES < map->face_count) {
+      render_shadow_face(map, i % SHADOW_CUBE_FACES);
+    }
+  }
+}
+
+// depth only pass over the draw list. only triangles that face away from the light are drawn, which keeps lit surfaces
+// out of their own shadow with a small bias, at the cost of open geometry that faces the light not casting shadows
+void render_shadow_face(const Shadow_map* map, i32 face) {
+  const v3 light_pos = renderer.lights[map->light_index].pos;
+  const i32 size = map->size;
+  f32* depth = &map->depth[face * size * size];
+  Vertex input[MAX_SHADOW_CLIP_VERTICES] = {0};
+  Vertex output[MAX_SHADOW_CLIP_VERTICES] = {0};
+  Vertex* clip_buffer[2] = { input, output };
+  memset(depth, 0, sizeof(f32) * size * size);
+
+  for (u32 draw_index = 0; draw_index < renderer.draw_count; ++draw_index) {
+    const Draw* draw = &renderer.draws[draw_index];
+    const Mesh* mesh = draw->mesh;
+    const m4 mvp = m4_multiply(map->face_vp[face], draw->model);
+    for (u32 i = 0; i < mesh->vertex_index_count; i += 3) {
+      const v3 v[3] = {
+        mesh->vertex[mesh->vertex_index[i + 0]],
+        mesh->vertex[mesh->vertex_index[i + 1]],
+        mesh->vertex[mesh->vertex_index[i + 2]],
+      };
+      const v3 wp[3] = {
+        m4_multiply_v3(draw->model, v[0]),
+        m4_multiply_v3(draw->model, v[1]),
+        m4_multiply_v3(draw->model, v[2]),
+      };
+      if (v3_dot(v3_cross(v3_sub(wp[1], wp[0]), v3_sub(wp[2], wp[0])), V3_OP(light_pos, wp[0], -)) >= 0) {
+        continue;
+      }
+      const v3 clip[3] = {
+        m4_multiply_v3(mvp, v[0]),
+        m4_multiply_v3(mvp, v[1]),
+        m4_multiply_v3(mvp, v[2]),
+      };
+      if (clip[0].w < SHADOW_NEAR && clip[1].w < SHADOW_NEAR && clip[2].w < SHADOW_NEAR) {
+        continue;
+      }
+
+      // near plane clipping in clip space, after which every vertex can be divided by w. z holds 1/w from here on
+      i32 count = 0;
+      for (i32 k = 0; k < 3; ++k) {
+        const v3 a = clip[k];
+        const v3 b = clip[(k + 1) % 3];
+        if (a.w >= SHADOW_NEAR) {
+          input[count++].p = V3(a.x / a.w, a.y / a.w, 1.0f / a.w);
+        }
+        if ((a.w >= SHADOW_NEAR) != (b.w >= SHADOW_NEAR)) {
+          const f32 t = (SHADOW_NEAR - a.w) / (b.w - a.w);
+          const f32 x = a.x + (b.x - a.x) * t;
+          const f32 y = a.y + (b.y - a.y) * t;
+          input[count++].p = V3(x / SHADOW_NEAR, y / SHADOW_NEAR, 1.0f / SHADOW_NEAR);
+        }
+      }
+      // the edges of the face
+      i32 clip_buffer_index = 0;
+      for (i32 plane_index = 0; plane_index < 4 && count > 0; ++plane_index, ++clip_buffer_index) {
+        Vertex* in = clip_buffer[clip_buffer_index % LENGTH(clip_buffer)];
+        Vertex* out = clip_buffer[(clip_buffer_index + 1) % LENGTH(clip_buffer)];
+        switch (plane_index) {
+          case 0: count = clip_vertices(in, out, count, V3(-1, 0, 0), V3(1, 0, 0)); break;
+          case 1: count = clip_vertices(in, out, count, V3(1, 0, 0), V3(-1, 0, 0)); break;
+          case 2: count = clip_vertices(in, out, count, V3(0, -1, 0), V3(0, 1, 0)); break;
+          default: count = clip_vertices(in, out, count, V3(0, 1, 0), V3(0, -1, 0)); break;
+        }
+      }
+      Vertex* clipped = clip_buffer[clip_buffer_index % LENGTH(clip_buffer)];
+      for (i32 k = 0; k < count; ++k) {
+        clipped[k].p = project_to_screen(clipped[k].p, size, size);
+      }
+      for (i32 k = 1; k + 1 < count; ++k) {
+        rasterize_depth(depth, size, clipped[0].p, clipped[k].p, clipped[k + 1].p);
+      }
+    }
+  }
+}
+
+// depth only variant of rasterize_triangle for the shadow maps, with incremental edge functions and no texture, light or
+// color work. z of the vertices holds 1/w, and the nearest (largest) value is kept
+void rasterize_depth(f32* depth, i32 size, v3 a, v3 b, v3 c) {
+  const i32 x1 = a.x, y1 = a.y;
+  const i32 x2 = b.x, y2 = b.y;
+  const i32 x3 = c.x, y3 = c.y;
+  const i32 det = (x1 - x3) * (y2 - y3) - (x2 - x3) * (y1 - y3);
+  if (det == 0) {
+    return;
+  }
+  const i32 min_x = MAX(MIN3(x1, x2, x3), 0);
+  const i32 min_y = MAX(MIN3(y1, y2, y3), 0);
+  const i32 max_x = MIN(MAX3(x1, x2, x3), size - 1);
+  const i32 max_y = MIN(MAX3(y1, y2, y3), size - 1);
+
+  // the same edge functions as barycentric, with the sign of the determinant folded in so that inside is non-negative
+  const i32 sign = det > 0 ? 1 : -1;
+  const i32 area = det * sign;
+  const i32 u1_dx = sign * (y2 - y3);
+  const i32 u1_dy = sign * (x3 - x2);
+  const i32 u2_dx = sign * (y3 - y1);
+  const i32 u2_dy = sign * (x1 - x3);
+  i32 u1_row = u1_dx * (min_x - x3) + u1_dy * (min_y - y3);
+  i32 u2_row = u2_dx * (min_x - x3) + u2_dy * (min_y - y3);
+  const f32 z1 = (a.z - c.z) / area;
+  const f32 z2 = (b.z - c.z) / area;
+
+  for (i32 y = min_y; y <= max_y; ++y, u1_row += u1_dy, u2_row += u2_dy) {
+    i32 u1 = u1_row;
+    i32 u2 = u2_row;
+    f32* row = &depth[y * size];
+    for (i32 x = min_x; x <= max_x; ++x, u1 += u1_dx, u2 += u2_dx) {
+      if ((u1 | u2 | (area - u1 - u2)) >= 0) {
+        const f32 z = c.z + u1 * z1 + u2 * z2;
+        if (z > row[x]) {
+          row[x] = z;
+        }
+      }
+    }
+  }
+}
+
+// fraction of the light that reaches pos, from the face of the cube map that pos is in, or the only face of a spot light.
+// with shadow filtering, the four nearest texels are compared and the results blended (2x2 percentage closer filtering)
+f32 shadow_visibility(const Shadow_map* map, v3 pos) {
+  const v3 d = V3_OP(pos, renderer.lights[map->light_index].pos, -);
+  const f32 ax = ABS(f32, d.x);
+  const f32 ay = ABS(f32, d.y);
+  const f32 az = ABS(f32, d.z);
+  const i32 face = map->face_count == 1 ? 0 :
+    (ax >= ay && ax >= az) ? (d.x > 0 ? 0 : 1) : (ay >= az ? (d.y > 0 ? 2 : 3) : (d.z > 0 ? 4 : 5));
+  const v3 clip = m4_multiply_v3(map->face_vp[face], pos);
+  if (clip.w < SHADOW_NEAR) {
+    return 1;
+  }
+  const i32 size = map->size;
+  const f32* depth = &map->depth[face * size * size];
+  const f32 inv_w = 1.0f / clip.w;
+  // occluders have to be closer to the light than this
+  const f32 reference = inv_w * (1.0f + SHADOW_BIAS);
+  // texel (x, y) was sampled at exactly (x, y) by rasterize_depth
+  const f32 u = (clip.x * inv_w + 1.0f) * 0.5f * size;
+  const f32 v = (clip.y * inv_w + 1.0f) * 0.5f * size;
+  if (!renderer.shadow_filtering) {
+    const i32 x = CLAMP((i32)(u + 0.5f), 0, size - 1);
+    const i32 y = CLAMP((i32)(v + 0.5f), 0, size - 1);
+    return depth[y * size + x] > reference ? 0.0f : 1.0f;
+  }
+  const i32 x = (i32)floorf(u);
+  const i32 y = (i32)floorf(v);
+  const f32 fx = u - x;
+  const f32 fy = v - y;
+  const i32 x0 = CLAMP(x, 0, size - 1);
+  const i32 y0 = CLAMP(y, 0, size - 1);
+  const i32 x1 = CLAMP(x + 1, 0, size - 1);
+  const i32 y1 = CLAMP(y + 1, 0, size - 1);
+  const f32 lit00 = depth[y0 * size + x0] <= reference;
+  const f32 lit10 = depth[y0 * size + x1] <= reference;
+  const f32 lit01 = depth[y1 * size + x0] <= reference;
+  const f32 lit11 = depth[y1 * size + x1] <= reference;
+  return (lit00 * (1 - fx) + lit10 * fx) * (1 - fy) + (lit01 * (1 - fx) + lit11 * fx) * fy;
+}
+
 #ifndef NO_RENDER_COMMANDS
 void push_render_command(const Render_command* cmd) {
   ASSERT(cmd);
@@ -321,7 +979,7 @@ void process_render_commands(void) {
         Texture* texture = &cmd->prim.texture;
         Triangle* t = &cmd->prim.triangle;
         if (texture->data) {
-          render_triangle_advanced(t->a, t->b, t->c, texture, cmd->prim.world_normal, cmd->prim.world_position, cmd->prim.light);
+          render_triangle_advanced(t->a, t->b, t->c, texture, cmd->prim.world_normal, cmd->prim.world_position, cmd->prim.mode, cmd->prim.light_mask);
         }
         break;
       }
@@ -359,26 +1017,203 @@ void process_render_commands(void) {
   }
 }
 
+// returns false if the commands can't be binned, in which case they have to be processed as usual
+bool bin_render_commands(void) {
+  const i32 tiles_x = (renderer.width + TILE_SIZE - 1) / TILE_SIZE;
+  const i32 tiles_y = (renderer.height + TILE_SIZE - 1) / TILE_SIZE;
+  const i32 tile_count = tiles_x * tiles_y;
+  u32* offset = &renderer.tile_bin_offset[0];
+  memset(offset, 0, sizeof(u32) * (tile_count + 1));
+
+  for (size_t i = 0; i < renderer.render_command_count; ++i) {
+    if (renderer.render_commands[i].type != RENDER_CMD_DRAW_TRIANGLE) {
+      // state changes are global and ordered, tiles are not
+      return false;
+    }
+  }
+
+  // count, then write render command indices into their bins (two passes, to keep the bins packed)
+  for (i32 pass = 0; pass < 2; ++pass) {
+    for (size_t i = 0; i < renderer.render_command_count; ++i) {
+      Render_command* cmd = &renderer.render_commands[i];
+      Triangle* t = &cmd->prim.triangle;
+      Rect bb = {0};
+      if (!cmd->prim.texture.data) {
+        continue;
+      }
+      if (!triangle_bb(t->a.p.x, t->a.p.y, t->b.p.x, t->b.p.y, t->c.p.x, t->c.p.y, &bb)) {
+        renderer.num_primitives_culled += (pass == 0);
+        continue;
+      }
+      renderer.num_primitives += (pass == 0);
+      i32 tx1 = MAX(bb.x1 - TILE_APRON, 0) / TILE_SIZE;
+      i32 ty1 = MAX(bb.y1 - TILE_APRON, 0) / TILE_SIZE;
+      i32 tx2 = MIN(bb.x2 - 1 + TILE_APRON, renderer.width - 1) / TILE_SIZE;
+      i32 ty2 = MIN(bb.y2 - 1 + TILE_APRON, renderer.height - 1) / TILE_SIZE;
+      for (i32 ty = ty1; ty <= ty2; ++ty) {
+        for (i32 tx = tx1; tx <= tx2; ++tx) {
+          i32 tile = ty * tiles_x + tx;
+          if (pass == 0) {
+            offset[tile + 1] += 1;
+          }
+          else {
+            renderer.tile_bin[offset[tile]++] = i;
+          }
+        }
+      }
+    }
+    if (pass == 0) {
+      for (i32 tile = 0; tile < tile_count; ++tile) {
+        offset[tile + 1] += offset[tile];
+      }
+      if (offset[tile_count] > MAX_TILE_BIN_ENTRIES) {
+        renderer.num_primitives = 0;
+        renderer.num_primitives_culled = 0;
+        return false;
+      }
+    }
+  }
+  // the fill pass advanced every offset to the start of the next bin
+  for (i32 tile = tile_count; tile > 0; --tile) {
+    offset[tile] = offset[tile - 1];
+  }
+  offset[0] = 0;
+  return true;
+}
+
+void render_tile(i32 tile_x, i32 tile_y) {
+  const i32 tiles_x = (renderer.width + TILE_SIZE - 1) / TILE_SIZE;
+  const i32 tile = tile_y * tiles_x + tile_x;
+  const Rect rect = (Rect) {
+    .x1 = tile_x * TILE_SIZE,
+    .y1 = tile_y * TILE_SIZE,
+    .x2 = MIN((tile_x + 1) * TILE_SIZE, renderer.width),
+    .y2 = MIN((tile_y + 1) * TILE_SIZE, renderer.height),
+  };
+  Tile local;
+  const Raster_target rt = (Raster_target) {
+    .color = local.color,
+    .zbuffer = local.zbuffer,
+#ifndef NO_NORMAL_BUFFER
+    .normal_buffer = local.normal_buffer,
+#endif
+    .bounds = (Rect) {
+      .x1 = rect.x1 - TILE_APRON,
+      .y1 = rect.y1 - TILE_APRON,
+      .x2 = rect.x1 - TILE_APRON + TILE_STRIDE,
+      .y2 = rect.y1 - TILE_APRON + TILE_STRIDE,
+    },
+    .stride = TILE_STRIDE,
+  };
+
+  // clear, including the apron
+  for (i32 y = rt.bounds.y1, i = 0; y < rt.bounds.y2; ++y) {
+    for (i32 x = rt.bounds.x1; x < rt.bounds.x2; ++x, ++i) {
+      if (fb_bounds_check(x, y)) {
+        i32 index = pixel_index(x, y);
+        local.color[i] = clear_color_at(index);
+        local.zbuffer[i] = renderer.clear_zbuffer[index];
+#ifndef NO_NORMAL_BUFFER
+        local.normal_buffer[i] = renderer.clear_normal_buffer[index];
+#endif
+      }
+      else {
+        local.color[i] = COLOR_RGB(0, 0, 0);
+        local.zbuffer[i] = 1.0f;
+#ifndef NO_NORMAL_BUFFER
+        local.normal_buffer[i] = COLOR_RGB(0, 0, 0);
+#endif
+      }
+    }
+  }
+
+  for (u32 i = renderer.tile_bin_offset[tile]; i < renderer.tile_bin_offset[tile + 1]; ++i) {
+    Render_command* cmd = &renderer.render_commands[renderer.tile_bin[i]];
+    Triangle* t = &cmd->prim.triangle;
+    rasterize_triangle(&rt, t->a, t->b, t->c, &cmd->prim.texture, cmd->prim.world_normal, cmd->prim.world_position, cmd->prim.mode, cmd->prim.light_mask);
+  }
+
+  const bool post_process = !low_res_effects();
+  if (post_process) {
+    post_process_rect(&rt, rect);
+  }
+
+  // the only framebuffer write. z is always written back, so that anything drawn after renderer_draw is depth tested against
+  // the frame. normals are only written back when they are about to be displayed or post processed
+  Raster_target fb = main_raster_target();
+  for (i32 y = rect.y1; y < rect.y2; ++y) {
+    i32 x = rect.x1;
+    i32 index = target_index(&fb, x, y);
+    i32 local_index = target_index(&rt, x, y);
+    for (; x < rect.x2; index = target_index_next(&fb, index, x), ++x, ++local_index) {
+      fb.color[index] = local.color[local_index];
+      fb.zbuffer[index] = local.zbuffer[local_index];
+#ifndef NO_NORMAL_BUFFER
+      if (renderer.render_normal_buffer || !post_process) {
+        fb.normal_buffer[index] = local.normal_buffer[local_index];
+      }
+#endif
+    }
+  }
+}
+
+void render_tiles(void) {
+  const i32 tiles_x = (renderer.width + TILE_SIZE - 1) / TILE_SIZE;
+  const i32 tiles_y = (renderer.height + TILE_SIZE - 1) / TILE_SIZE;
+  i32 tile = 0;
+
+  #pragma omp parallel for
+  for (tile = 0; tile < tiles_x * tiles_y; ++tile) {
+    render_tile(tile % tiles_x, tile / tiles_x);
+  }
+}
+
 #endif // NO_RENDER_COMMANDS
 
 void renderer_init(Color* color_buffer, Color* clear_buffer, u32 width, u32 height) {
+  renderer.display_buffer = color_buffer;
+#ifdef TILED_FRAMEBUFFER
+  ASSERT((width & FB_BLOCK_MASK) == 0 && (height & FB_BLOCK_MASK) == 0);
+  renderer.color_buffer = renderer.tiled_color_buffer;
+#else
   renderer.color_buffer = color_buffer;
+#endif
   renderer.clear_buffer = clear_buffer;
   renderer_set_render_target(RENDER_TARGET_COLOR);
   renderer.zbuffer_target = renderer.zbuffer;
   renderer.width = width;
   renderer.height = height;
   renderer.blend_mode = BLEND_NONE;
+  renderer.mode = MODE_TEXTURE | MODE_DEPTH_TEST;
   renderer.dither = DITHERING;
   renderer.fog = FOG;
+  renderer.vertex_fog = VERTEX_FOG;
+  fog_lut_build(FOG_DENSITY);
+  dither_build(DITHER_SIZE, DITHER_BITS);
   renderer.edge_detection = EDGE_DETECTION;
+  renderer.edge_detection_depth = EDGE_DETECTION_DEPTH;
+  renderer.edge_detection_low_res = EDGE_DETECTION_LOW_RES;
+  renderer.ambient_occlusion = AMBIENT_OCCLUSION;
+  renderer.low_res_scale = LOW_RES_SCALE;
   renderer.render_zbuffer = false;
   renderer.render_normal_buffer = false;
   renderer.num_primitives = 0;
   renderer.num_primitives_culled = 0;
+  renderer.num_fragments = 0;
   renderer.dt = 0;
   renderer.depth_test = true;
   renderer.texture_mapping = true;
+  renderer.bilinear_filtering = BILINEAR_FILTERING;
+  renderer.shadow_filtering = SHADOW_FILTERING;
+  renderer.tile_rendering = TILE_RENDERING;
+  renderer.clear_pending = false;
+  renderer.post_processed = false;
+  renderer.light_count = 0;
+  renderer.ambience = LIGHT_AMBIENCE;
+  memset(renderer.light_tile_mask, 0, sizeof(renderer.light_tile_mask));
+  renderer.shadow_map_count = 0;
+  renderer.shadow_texel_count = 0;
+  renderer.draw_count = 0;
 #ifndef NO_RENDER_COMMANDS
   renderer.render_command_count = 0;
   renderer.render_texture_count = 0;
@@ -398,6 +1233,10 @@ void renderer_set_blend_mode(Blend mode) {
   renderer.blend_mode = mode;
 }
 
+void renderer_set_render_mode(u32 mode) {
+  renderer.mode = mode;
+}
+
 void renderer_set_render_target(Render_target render_target) {
   switch (render_target) {
     case RENDER_TARGET_COLOR: {
@@ -581,6 +1420,8 @@ void render_texture_triangle(i32 x1, i32 y1, i32 x2, i32 y2, i32 x3, i32 y3, f32
     255 * light_contrib,
     255 * light_contrib
   );
+#else
+  const Texture_sampler sample = texture_get_sampler(texture);
 #endif
 
 #ifdef DRAW_BB
@@ -613,9 +1454,9 @@ void render_texture_triangle(i32 x1, i32 y1, i32 x2, i32 y2, i32 x3, i32 y3, f32
           continue;
         }
         v2 uv = v2_cartesian(uv1, uv2, uv3, w1, w2, w3);
-        i32 x_coord = (ABS(i32, texture->width * uv.x)) % texture->width;
-        i32 y_coord = (ABS(i32, texture->height * uv.y)) % texture->height;
-        texel = texture_get_pixel(texture, x_coord, y_coord);
+        i32 x_coord = ABS(i32, texture->width * uv.x);
+        i32 y_coord = ABS(i32, texture->height * uv.y);
+        texel = sample(texture, x_coord, y_coord);
         texel.r *= light_contrib;
         texel.g *= light_contrib;
         texel.b *= light_contrib;
@@ -627,26 +1468,109 @@ void render_texture_triangle(i32 x1, i32 y1, i32 x2, i32 y2, i32 x3, i32 y3, f32
   renderer.num_primitives += 1;
 }
 
-void render_triangle_advanced(Vertex a, Vertex b, Vertex c, const Texture* texture, v3 world_normal, v3 world_position, Light light) {
-  Rect bb = {0};
-  if (!triangle_bb(a.p.x, a.p.y, b.p.x, b.p.y, c.p.x, c.p.y, &bb)) {
+void render_triangle_advanced(Vertex a, Vertex b, Vertex c, const Texture* texture, v3 world_normal, v3 world_position, u32 mode, u64 light_mask) {
+  Raster_target rt = main_raster_target();
+  if (!rasterize_triangle(&rt, a, b, c, texture, world_normal, world_position, mode, light_mask)) {
     renderer.num_primitives_culled += 1;
     return;
   }
-
-  Color texel = COLOR_RGB(255, 0, 255);
 #ifdef DRAW_BB
+  Rect bb = {0};
+  triangle_bb(a.p.x, a.p.y, b.p.x, b.p.y, c.p.x, c.p.y, &bb);
   render_rect(bb.x, bb.y, bb.w - bb.x, bb.h - bb.y, BB_COLOR);
 #endif
+  renderer.num_primitives += 1;
+}
+
+// returns false if no part of the triangle is inside the target
+bool rasterize_triangle(const Raster_target* rt, Vertex a, Vertex b, Vertex c, const Texture* texture, v3 world_normal, v3 world_position, u32 mode, u64 light_mask) {
+  Rect bb = {0};
+  if (!triangle_bb(a.p.x, a.p.y, b.p.x, b.p.y, c.p.x, c.p.y, &bb)) {
+    return false;
+  }
+  bb.x1 = MAX(bb.x1, rt->bounds.x1);
+  bb.y1 = MAX(bb.y1, rt->bounds.y1);
+  bb.x2 = MIN(bb.x2, rt->bounds.x2);
+  bb.y2 = MIN(bb.y2, rt->bounds.y2);
+  if (bb.x2 <= bb.x1 || bb.y2 <= bb.y1) {
+    return false;
+  }
+
+#ifndef NO_TEXTURES
+  // level of detail from the ratio of texture area to screen area covered by the triangle
+  if (texture->mip_count > 0) {
+    f32 pixel_area = ABS(f32, (b.p.x - a.p.x) * (c.p.y - a.p.y) - (c.p.x - a.p.x) * (b.p.y - a.p.y));
+    f32 texel_area = ABS(f32, (b.uv.x - a.uv.x) * (c.uv.y - a.uv.y) - (c.uv.x - a.uv.x) * (b.uv.y - a.uv.y)) * texture->width * texture->height;
+    if (pixel_area > 0) {
+      texture = texture_get_mip(texture, texel_area / pixel_area);
+    }
+  }
+  const Texture_sampler sample = texture_get_sampler(texture);
+  const bool bilinear = renderer.bilinear_filtering;
+#endif
+
+  Color texel = COLOR_RGB(255, 0, 255);
+  i32 fragments = 0;
+
+  const bool depth_test = renderer.depth_test && (mode & MODE_DEPTH_TEST);
+  const bool texture_mapping = renderer.texture_mapping && (mode & MODE_TEXTURE);
+  const bool vertex_fog = (mode & MODE_VERTEX_FOG) != 0;
+  const Color fog_color = FOG_COLOR;
 
   f32 light_contrib = 0;
 #ifndef NO_LIGHTING
-  f32 light_contribs[3] = {
-    light_calculate_contribution(light, a.wp, world_normal),
-    light_calculate_contribution(light, b.wp, world_normal),
-    light_calculate_contribution(light, c.wp, world_normal)
-  };
+  // the normals of a flat triangle are the same at every pixel, and are only interpolated between differing ones
+  const bool vertex_normals = (mode & MODE_VERTEX_NORMAL) != 0;
+  const bool smooth_normals = vertex_normals && !(
+    a.normal.x == b.normal.x && a.normal.y == b.normal.y && a.normal.z == b.normal.z &&
+    a.normal.x == c.normal.x && a.normal.y == c.normal.y && a.normal.z == c.normal.z
+  );
+  const v3 flat_normal = vertex_normals ? a.normal : world_normal;
+
+  // only the lights that reach the tiles under the triangle, and that are in front of its plane and within range of it.
+  // baked triangles already have all of their light, from the static lights that they were baked with, and so do
+  // triangles that were lit per mesh vertex
+  const bool baked_lighting = (mode & (MODE_BAKED_LIGHTING | MODE_VERTEX_LIGHT)) != 0;
+  u8 lights[MAX_LIGHTS];
+  u32 light_count = 0;
+  light_mask = (baked_lighting || !light_mask) ? 0 : light_mask & light_mask_rect(bb);
+  while (light_mask) {
+    const u32 light_index = __builtin_ctzll(light_mask);
+    const Light* light = &renderer.lights[light_index];
+    const f32 plane_distance = v3_dot(world_normal, V3_OP(light->pos, a.wp, -));
+    light_mask &= light_mask - 1;
+    if (plane_distance > 0 && plane_distance <= renderer.light_range[light_index]) {
+      lights[light_count++] = light_index;
+    }
+  }
+  const bool pixel_lighting = (mode & MODE_PIXEL_LIGHTING) && light_count > 0;
+  // out of reach of every light, so the whole triangle is lit by the ambience alone
+  const bool ambient_lighting = !baked_lighting && light_count == 0;
+  if (ambient_lighting) {
+    light_contrib = renderer.ambience;
+  }
+  Pixel_batch batch;
+  batch.count = 0;
+
+  f32 light_contribs[3] = {0, 0, 0};
+  if (baked_lighting) {
+    light_contribs[0] = CLAMP(a.light, renderer.ambience, 1);
+    light_contribs[1] = CLAMP(b.light, renderer.ambience, 1);
+    light_contribs[2] = CLAMP(c.light, renderer.ambience, 1);
+  }
+  else if (!pixel_lighting && !ambient_lighting) {
+    for (u32 i = 0; i < light_count; ++i) {
+      const Light* light = &renderer.lights[lights[i]];
+      light_contribs[0] += light_calculate_intensity(*light, a.wp, world_normal);
+      light_contribs[1] += light_calculate_intensity(*light, b.wp, world_normal);
+      light_contribs[2] += light_calculate_intensity(*light, c.wp, world_normal);
+    }
+    for (i32 i = 0; i < 3; ++i) {
+      light_contribs[i] = CLAMP(light_contribs[i], renderer.ambience, 1);
+    }
+  }
 #else
+  const bool ambient_lighting = false;
   f32 light_contribs[3] = {
     1, 1, 1
   };
@@ -654,9 +1578,10 @@ void render_triangle_advanced(Vertex a, Vertex b, Vertex c, const Texture* textu
 
   for (i32 y = bb.y1; y < bb.y2; ++y) {
     i32 x = bb.x1;
-    Color* target = get_pixel_addr(x, y);
-    f32* zvalue = get_zbuffer_addr(x, y);
-    for (; x < bb.x2; ++x, ++target, ++zvalue) {
+    i32 index = target_index(rt, x, y);
+    for (; x < bb.x2; index = target_index_next(rt, index, x), ++x) {
+      Color* target = &rt->color[index];
+      f32* zvalue = &rt->zbuffer[index];
       i32 u1, u2, det = 0;
       // TODO: use v3_barycentric here instead
       if (barycentric(a.p.x, a.p.y, b.p.x, b.p.y, c.p.x, c.p.y, x, y, &u1, &u2, &det)) {
@@ -666,12 +1591,12 @@ void render_triangle_advanced(Vertex a, Vertex b, Vertex c, const Texture* textu
           w2 = u2 / (f32)det;
         }
         w3 = 1.0f - w1 - w2;
-        if (renderer.depth_test) {
+        if (depth_test) {
           f32 z = (a.p.z * w1) + (b.p.z * w2) + (c.p.z * w3);
           if (z < *zvalue) {
             *zvalue = z;
 #ifndef NO_NORMAL_BUFFER
-            renderer.normal_buffer[y * renderer.width + x] = COLOR_RGB(
+            rt->normal_buffer[index] = COLOR_RGB(
               UINT8_MAX * (1 + world_normal.x) * 0.5f,
               UINT8_MAX * (1 + world_normal.y) * 0.5f,
               UINT8_MAX * (1 + world_normal.z) * 0.5f
@@ -682,25 +1607,116 @@ void render_triangle_advanced(Vertex a, Vertex b, Vertex c, const Texture* textu
             continue;
           }
         }
-        light_contrib = light_contribs[0] * w1 + light_contribs[1] * w2 + light_contribs[2] * w3;
         texel = COLOR_RGB(255, 255, 255);
 #ifndef NO_TEXTURES
-        if (renderer.texture_mapping) {
+        if (texture_mapping) {
           v2 uv = v2_cartesian(a.uv, b.uv, c.uv, w1, w2, w3);
-          i32 x_coord = ABS(i32, texture->width * uv.x);
-          i32 y_coord = ABS(i32, texture->height * uv.y);
-          texel = texture_get_pixel_wrapped(texture, x_coord, y_coord);
+          if (bilinear) {
+            // offset by half a texel so that the footprint is centered on the sample point
+            const f32 scale = 1 << TEXTURE_SUBTEXEL_BITS;
+            i32 u = ABS(i32, texture->width * uv.x * scale - scale * 0.5f);
+            i32 v = ABS(i32, texture->height * uv.y * scale - scale * 0.5f);
+            texel = texture_sample_bilinear(texture, sample, u, v);
+          }
+          else {
+            i32 x_coord = ABS(i32, texture->width * uv.x);
+            i32 y_coord = ABS(i32, texture->height * uv.y);
+            texel = sample(texture, x_coord, y_coord);
+          }
         }
 #endif
+        fragments += 1;
+#ifndef NO_LIGHTING
+        if (pixel_lighting) {
+          // lit once the batch is full
+          const i32 i = batch.count++;
+          batch.x[i] = (a.wp.x * w1) + (b.wp.x * w2) + (c.wp.x * w3);
+          batch.y[i] = (a.wp.y * w1) + (b.wp.y * w2) + (c.wp.y * w3);
+          batch.z[i] = (a.wp.z * w1) + (b.wp.z * w2) + (c.wp.z * w3);
+          v3 normal = flat_normal;
+          if (smooth_normals) {
+            // shorter than unit length between differing normals, so normalized again
+            normal = v3_normalize_fast(V3(
+              (a.normal.x * w1) + (b.normal.x * w2) + (c.normal.x * w3),
+              (a.normal.y * w1) + (b.normal.y * w2) + (c.normal.y * w3),
+              (a.normal.z * w1) + (b.normal.z * w2) + (c.normal.z * w3)
+            ));
+          }
+          batch.nx[i] = normal.x;
+          batch.ny[i] = normal.y;
+          batch.nz[i] = normal.z;
+          batch.texel[i] = texel;
+          batch.fog[i] = vertex_fog ? ((a.fog * w1) + (b.fog * w2) + (c.fog * w3)) * BLEND_ONE : 0;
+          batch.target[i] = target;
+          if (batch.count == PIXEL_BATCH_SIZE) {
+            pixel_batch_flush(&batch, lights, light_count);
+          }
+          continue;
+        }
+#endif
+        if (!ambient_lighting) {
+          light_contrib = light_contribs[0] * w1 + light_contribs[1] * w2 + light_contribs[2] * w3;
+        }
         texel.r *= light_contrib;
         texel.g *= light_contrib;
         texel.b *= light_contrib;
+        if (vertex_fog) {
+          texel = color_blend(texel, fog_color, ((a.fog * w1) + (b.fog * w2) + (c.fog * w3)) * BLEND_ONE);
+        }
         draw_pixel(target, texel);
       }
     }
   }
-  renderer.num_primitives += 1;
+#ifndef NO_LIGHTING
+  if (batch.count > 0) {
+    pixel_batch_flush(&batch, lights, light_count);
+  }
+#endif
+#pragma omp atomic
+  renderer.num_fragments += fragments;
+  return true;
+}
+
+#ifndef NO_LIGHTING
+// light the batched pixels with the selected lights, four at a time. unused slots of a partial batch are lit too, and discarded
+void pixel_batch_flush(Pixel_batch* batch, const u8* lights, u32 light_count) {
+  f32 intensity[PIXEL_BATCH_SIZE] = {0};
+  for (i32 i = batch->count; i < PIXEL_BATCH_SIZE; ++i) {
+    batch->x[i] = batch->x[0];
+    batch->y[i] = batch->y[0];
+    batch->z[i] = batch->z[0];
+    batch->nx[i] = batch->nx[0];
+    batch->ny[i] = batch->ny[0];
+    batch->nz[i] = batch->nz[0];
+  }
+  for (u32 i = 0; i < light_count; ++i) {
+    const i32 shadow_map = renderer.light_shadow_map[lights[i]];
+    if (shadow_map < 0) {
+      light_accumulate_intensity4(&renderer.lights[lights[i]], batch->x, batch->y, batch->z, batch->nx, batch->ny, batch->nz, intensity);
+      continue;
+    }
+    f32 lit[PIXEL_BATCH_SIZE] = {0};
+    light_accumulate_intensity4(&renderer.lights[lights[i]], batch->x, batch->y, batch->z, batch->nx, batch->ny, batch->nz, lit);
+    for (i32 j = 0; j < batch->count; ++j) {
+      if (lit[j] > 0) {
+        intensity[j] += lit[j] * shadow_visibility(&renderer.shadow_maps[shadow_map], V3(batch->x[j], batch->y[j], batch->z[j]));
+      }
+    }
+  }
+  for (i32 i = 0; i < batch->count; ++i) {
+    const f32 light_contrib = CLAMP(intensity[i], renderer.ambience, 1);
+    Color texel = batch->texel[i];
+    texel.r *= light_contrib;
+    texel.g *= light_contrib;
+    texel.b *= light_contrib;
+    if (batch->fog[i]) {
+      texel = color_blend(texel, FOG_COLOR, batch->fog[i]);
+    }
+    draw_pixel(batch->target[i], texel);
+  }
+  batch->count = 0;
 }
+#endif
 
 void render_fill_circle(i32 px, i32 py, i32 r, Color color) {
   Rect rect = {0};
@@ -712,12 +1728,11 @@ void render_fill_circle(i32 px, i32 py, i32 r, Color color) {
 #endif
   for (i32 y = rect.y; y <= rect.y + rect.h; ++y) {
     i32 x = rect.x;
-    Color* target = get_pixel_addr(x, y);
-    for (; x <= rect.x + rect.w; ++x, ++target) {
+    for (; x <= rect.x + rect.w; ++x) {
       i32 dx = (x * 2 - px * 2);
       i32 dy = (y * 2 - py * 2);
       if (dx * dx + dy * dy <= r * r * 2 * 2) {
-        draw_pixel(target, color);
+        draw_pixel(get_pixel_addr(x, y), color);
       }
     }
   }
@@ -766,6 +1781,7 @@ void render_texture(Texture* texture, i32 x, i32 y, i32 w, i32 h) {
   if (!normalize_rect(x, y, w, h, &rect)) {
     return;
   }
+  const Texture_sampler sample = texture_get_sampler(texture);
   i32 x_max = x + w;
   i32 y_max = y + h;
   i32 ty = 0;
@@ -773,11 +1789,11 @@ void render_texture(Texture* texture, i32 x, i32 y, i32 w, i32 h) {
     i32 tx = 0;
     i32 rx = rect.x;
     i32 ydelta = y_max - ry;
-    Color* target = get_pixel_addr(rx, ry);
-    for (; rx < rect.x + rect.w; ++rx, ++tx, ++target) {
+    for (; rx < rect.x + rect.w; ++rx, ++tx) {
+      Color* target = get_pixel_addr(rx, ry);
       i32 xdelta = x_max - rx;
       v2 uv = V2(xdelta / (f32)w, ydelta / (f32)h);
-      Color color = texture_get_pixel_wrapped(texture, uv.x * texture->width, uv.y * texture->height);
+      Color color = sample(texture, uv.x * texture->width, uv.y * texture->height);
       draw_pixel(target, color);
     }
   }
@@ -788,6 +1804,7 @@ void render_texture_with_mask(Texture* texture, i32 x, i32 y, i32 w, i32 h, Colo
   if (!normalize_rect(x, y, w, h, &rect)) {
     return;
   }
+  const Texture_sampler sample = texture_get_sampler(texture);
   i32 x_max = x + w;
   i32 y_max = y + h;
   i32 ty = 0;
@@ -795,11 +1812,11 @@ void render_texture_with_mask(Texture* texture, i32 x, i32 y, i32 w, i32 h, Colo
     i32 tx = 0;
     i32 rx = rect.x;
     i32 ydelta = y_max - ry;
-    Color* target = get_pixel_addr(rx, ry);
-    for (; rx < rect.x + rect.w; ++rx, ++tx, ++target) {
+    for (; rx < rect.x + rect.w; ++rx, ++tx) {
+      Color* target = get_pixel_addr(rx, ry);
       i32 xdelta = x_max - rx;
       v2 uv = V2(xdelta / (f32)w, ydelta / (f32)h);
-      Color color = texture_get_pixel_wrapped(texture, uv.x * texture->width, uv.y * texture->height);
+      Color color = sample(texture, uv.x * texture->width, uv.y * texture->height);
       if ((color.value & mask.value) != color.value) {
         draw_pixel(target, color);
       }
@@ -812,6 +1829,7 @@ void render_texture_with_mask_and_tint(Texture* texture, i32 x, i32 y, i32 w, i3
   if (!normalize_rect(x, y, w, h, &rect)) {
     return;
   }
+  const Texture_sampler sample = texture_get_sampler(texture);
   i32 x_max = x + w;
   i32 y_max = y + h;
   i32 ty = 0;
@@ -819,11 +1837,11 @@ void render_texture_with_mask_and_tint(Texture* texture, i32 x, i32 y, i32 w, i3
     i32 tx = 0;
     i32 rx = rect.x;
     i32 ydelta = y_max - ry;
-    Color* target = get_pixel_addr(rx, ry);
-    for (; rx < rect.x + rect.w; ++rx, ++tx, ++target) {
+    for (; rx < rect.x + rect.w; ++rx, ++tx) {
+      Color* target = get_pixel_addr(rx, ry);
       i32 xdelta = x_max - rx;
       v2 uv = V2(xdelta / (f32)w, ydelta / (f32)h);
-      Color color = texture_get_pixel_wrapped(texture, uv.x * texture->width, uv.y * texture->height);
+      Color color = sample(texture, uv.x * texture->width, uv.y * texture->height);
       if ((color.value & mask.value) != color.value) {
         f32 inv = 1.0f / UINT8_MAX;
         color.r = CLAMP((color.r * tint.r) * inv, 0, UINT8_MAX);
@@ -869,7 +1887,7 @@ void render_axis(v3 origin) {
 // TODO: bb and early cull
 // TODO: bvh?
 // TODO: view frustum culling/clipping in actual clip space, not in NDC
-void render_mesh(Mesh* mesh, Texture* texture, v3 position, v3 size, v3 rotation, Light light) {
+void render_mesh(Mesh* mesh, Texture* texture, v3 position, v3 size, v3 rotation) {
   m4 model = translate(position);
 
   model = m4_multiply(model, rotate(rotation.y, V3(0, 1, 0)));
@@ -879,8 +1897,52 @@ void render_mesh(Mesh* mesh, Texture* texture, v3 position, v3 size, v3 rotation
   model = m4_multiply(model, scale(size));
 
   m4 vp = m4_multiply(projection, view); // TODO: calculate once per frame
+  // meshes without baked light are lit at runtime, even when drawn in the baked mode
+  u32 mode = mesh->light ? renderer.mode : renderer.mode & ~MODE_BAKED_LIGHTING;
+#ifndef NO_LIGHTING
+  // per vertex lighting with the normals of the mesh, once for each vertex rather than for each corner of each triangle.
+  // per pixel lighting interpolates the normals of the vertices instead
+  const bool mesh_normals = mesh->normal_count > 0 && mesh->normal_index_count == mesh->vertex_index_count;
+  const bool vertex_lighting = mesh_normals && !(mode & (MODE_BAKED_LIGHTING | MODE_PIXEL_LIGHTING));
+  const bool vertex_normals = mesh_normals && !(mode & MODE_BAKED_LIGHTING) && (mode & MODE_PIXEL_LIGHTING);
+  if (vertex_lighting) {
+    mode |= MODE_VERTEX_LIGHT;
+  }
+  if (vertex_normals) {
+    mode |= MODE_VERTEX_NORMAL;
+  }
+  // the normals are transformed as directions, which is only correct for uniform scaling
+  const v3 model_origin = m4_multiply_v3(model, V3(0, 0, 0));
+#endif
+  if (renderer.fog && renderer.vertex_fog) {
+    mode |= MODE_VERTEX_FOG;
+  }
+  if (++renderer.draw_stamp == 0) {
+    memset(renderer.vertex_cache, 0, sizeof(renderer.vertex_cache));
+    renderer.draw_stamp = 1;
+  }
+
+  // lights whose range reaches the mesh, each triangle is then tested against these only
+  if (mesh->radius <= 0) {
+    mesh_compute_bounds(mesh);
+  }
+  u64 draw_light_mask = 0;
+  if (!(mode & MODE_BAKED_LIGHTING) && renderer.light_count > 0) {
+    const f32 sx = ABS(f32, size.x);
+    const f32 sy = ABS(f32, size.y);
+    const f32 sz = ABS(f32, size.z);
+    const f32 max_scale = MAX3(sx, sy, sz);
+    const u64 all_lights = renderer.light_count == MAX_LIGHTS ? ~(u64)0 : ((u64)1 << renderer.light_count) - 1;
+    draw_light_mask = light_mask_sphere(all_lights, m4_multiply_v3(model, mesh->center), mesh->radius * max_scale);
+  }
   m4 mvp = m4_multiply(projection, m4_multiply(view, model));
 
+#ifndef NO_RENDER_COMMANDS
+  if (renderer.draw_count < MAX_DRAWS) {
+    renderer.draws[renderer.draw_count++] = (Draw) { .mesh = mesh, .model = model, };
+  }
+#endif
+
   #define MAX_VERTEX_OUTPUT 9
   Vertex input[MAX_VERTEX_OUTPUT] = {0};
   Vertex output[MAX_VERTEX_OUTPUT] = {0};
@@ -898,24 +1960,24 @@ void render_mesh(Mesh* mesh, Texture* texture, v3 position, v3 size, v3 rotation
 
   // proj * view * model * pos
   for (i32 i = 0; i < mesh->vertex_index_count; i += 3) {
-    // original vertices
-    const v3 v[3] = {
-      mesh->vertex[mesh->vertex_index[i + 0]],
-      mesh->vertex[mesh->vertex_index[i + 1]],
-      mesh->vertex[mesh->vertex_index[i + 2]],
+    Vertex_cache_entry* cached[3] = {
+      vertex_cache_fetch(mesh, mesh->vertex_index[i + 0], model, mvp),
+      vertex_cache_fetch(mesh, mesh->vertex_index[i + 1], model, mvp),
+      vertex_cache_fetch(mesh, mesh->vertex_index[i + 2], model, mvp),
     };
 
+    // meshes without uvs are sampled at the corner of the texture
     const v2 uv[3] = {
-      mesh->uv[mesh->uv_index[i + 0]],
-      mesh->uv[mesh->uv_index[i + 1]],
-      mesh->uv[mesh->uv_index[i + 2]],
+      mesh->uv_index_count ? mesh->uv[mesh->uv_index[i + 0]] : V2(0, 0),
+      mesh->uv_index_count ? mesh->uv[mesh->uv_index[i + 1]] : V2(0, 0),
+      mesh->uv_index_count ? mesh->uv[mesh->uv_index[i + 2]] : V2(0, 0),
     };
 
     // vertex in world position
     const v3 vp[3] = {
-      m4_multiply_v3(model, v[0]),
-      m4_multiply_v3(model, v[1]),
-      m4_multiply_v3(model, v[2]),
+      cached[0]->world,
+      cached[1]->world,
+      cached[2]->world,
     };
     v3 pos = position;
 #ifndef UNIFORM_LIGHTING_POSITION
@@ -933,11 +1995,20 @@ void render_mesh(Mesh* mesh, Texture* texture, v3 position, v3 size, v3 rotation
       continue;
     }
 
+    u64 light_mask = 0;
+    if (draw_light_mask) {
+      const v3 center = V3_OP1(V3_OP(V3_OP(vp[0], vp[1], +), vp[2], +), 1/3.0f, *);
+      const f32 d0 = v3_length_square(V3_OP(vp[0], center, -));
+      const f32 d1 = v3_length_square(V3_OP(vp[1], center, -));
+      const f32 d2 = v3_length_square(V3_OP(vp[2], center, -));
+      light_mask = light_mask_sphere(draw_light_mask, center, square_root(MAX3(d0, d1, d2)));
+    }
+
     // transformed vertices
     v3 vt[3] = {
-      m4_multiply_v3(mvp, v[0]),
-      m4_multiply_v3(mvp, v[1]),
-      m4_multiply_v3(mvp, v[2]),
+      cached[0]->clip,
+      cached[1]->clip,
+      cached[2]->clip,
     };
 
     if (vt[0].w < EPS || vt[1].w < EPS || vt[2].w < EPS) {
@@ -963,6 +2034,25 @@ void render_mesh(Mesh* mesh, Texture* texture, v3 position, v3 size, v3 rotation
       v->wp = vp[input_index];
       v->p = vt[input_index];
       v->uv = uv[input_index];
+      v->light = mesh->light ? mesh->light[i + input_index] : 0;
+      v->normal = V3(0, 0, 0);
+#ifndef NO_LIGHTING
+      if (vertex_lighting || vertex_normals) {
+        Vertex_cache_entry* entry = cached[input_index];
+        const u32 normal_index = mesh->normal_index[i + input_index];
+        if (entry->normal_index != normal_index) {
+          entry->normal = v3_normalize_fast(v3_sub(m4_multiply_v3(model, mesh->normal[normal_index]), model_origin));
+          if (vertex_lighting) {
+            entry->light = vertex_light(draw_light_mask, entry->world, entry->normal);
+          }
+          entry->normal_index = normal_index;
+        }
+        if (vertex_lighting) {
+          v->light = entry->light;
+        }
+        v->normal = entry->normal;
+      }
+#endif
     }
     for (i32 plane_index = 0; plane_index < 6; ++plane_index, ++clip_buffer_index) {
       Vertex* input = clip_buffer[clip_buffer_index % LENGTH(clip_buffer)];
@@ -1006,6 +2096,8 @@ void render_mesh(Mesh* mesh, Texture* texture, v3 position, v3 size, v3 rotation
     for (i32 vertex_index = 0; vertex_index < output_count; ++vertex_index) {
       Vertex* v = &clipped[vertex_index];
       v->p = project_to_screen(v->p, renderer.width, renderer.height);
+      // from the depth after clipping, so that vertices on the clipping planes get the fog of where they are
+      v->fog = (f32)fog_at_depth(v->p.z) / BLEND_ONE;
     }
     Vertex first = clipped[0];
     for (i32 vertex_index = 1; vertex_index + 1 < output_count; vertex_index += 1) {
@@ -1023,14 +2115,15 @@ void render_mesh(Mesh* mesh, Texture* texture, v3 position, v3 size, v3 rotation
             first, clipped[vertex_index], clipped[vertex_index + 1],
           },
           .texture = *texture,
-          .light = light,
           .world_normal = world_normal,
           .world_position = pos,
+          .mode = mode,
+          .light_mask = light_mask,
         },
       };
       push_render_command(&cmd);
 #else
-      render_triangle_advanced(first, clipped[vertex_index], clipped[vertex_index + 1], texture, world_normal, pos, light);
+      render_triangle_advanced(first, clipped[vertex_index], clipped[vertex_index + 1], texture, world_normal, pos, mode, light_mask);
 #endif
     }
 
@@ -1054,6 +2147,10 @@ void render_text(const char* text, size_t length, i32 x, i32 y, f32 size, Color
   i32 x_offset = x;
   i32 y_offset = y;
   Color mask = COLOR_RGB(255, 0, 255);
+  const Glyph_masks* masks = glyph_masks_get(&font, size);
+  const Color color = text_color(tint);
+  f32 inv = 1.0f / UINT8_MAX;
+  const i32 pixel_size = size;
 
   for (i32 i = 0; i < length; ++i) {
     char code = text[i];
@@ -1066,15 +2163,28 @@ void render_text(const char* text, size_t length, i32 x, i32 y, f32 size, Color
       x_offset += font.width;
       continue;
     }
-    for (i32 gy = 0; gy < font.height; ++gy) {
-      for (i32 gx = 0; gx < font.width; ++gx) {
-        Color color = font_get_color(&font, gx, gy, code);
-        if (color.value != mask.value) {
-          f32 inv = 1.0f / UINT8_MAX;
-          color.r = CLAMP((color.r * tint.r) * inv, 0, UINT8_MAX);
-          color.g = CLAMP((color.g * tint.g) * inv, 0, UINT8_MAX);
-          color.b = CLAMP((color.b * tint.b) * inv, 0, UINT8_MAX);
-          render_fill_rect(x_offset + gx * size, y_offset + gy * size, size, size, color);
+    if (masks && code >= 0 && code < font.count) {
+      for (i32 gy = 0; gy < font.height; ++gy) {
+        const u64 row = masks->rows[(i32)code][gy];
+        if (!row) {
+          continue;
+        }
+        const i32 row_y = y_offset + (i32)(gy * size);
+        for (i32 ry = row_y; ry < row_y + pixel_size; ++ry) {
+          render_row_mask(x_offset, ry, row, color);
+        }
+      }
+    }
+    else if (!masks) {
+      for (i32 gy = 0; gy < font.height; ++gy) {
+        for (i32 gx = 0; gx < font.width; ++gx) {
+          Color color = font_get_color(&font, gx, gy, code);
+          if (color.value != mask.value) {
+            color.r = CLAMP((color.r * tint.r) * inv, 0, UINT8_MAX);
+            color.g = CLAMP((color.g * tint.g) * inv, 0, UINT8_MAX);
+            color.b = CLAMP((color.b * tint.b) * inv, 0, UINT8_MAX);
+            render_fill_rect(x_offset + gx * size, y_offset + gy * size, size, size, color);
+          }
         }
       }
     }
@@ -1082,120 +2192,822 @@ void render_text(const char* text, size_t length, i32 x, i32 y, f32 size, Color
   }
 }
 
+// glyph masks of the font at the text size, built the first time that they are needed.
+// NULL if the glyphs don't fit in the masks at that size, in which case text is drawn a glyph pixel at a time
+const Glyph_masks* glyph_masks_get(const Font* font, f32 size) {
+  const i32 pixel_size = size;
+  const i32 width = (i32)((font->width - 1) * size) + pixel_size;
+  if (pixel_size <= 0 || width > MAX_GLYPH_WIDTH || font->height > MAX_GLYPH_HEIGHT || font->count > MAX_GLYPHS) {
+    return NULL;
+  }
+  for (i32 i = 0; i < GLYPH_CACHE_SIZE; ++i) {
+    const Glyph_masks* masks = &renderer.glyph_cache[i];
+    if (masks->glyphs == font->glyphs && masks->size == size) {
+      return masks;
+    }
+  }
+  Glyph_masks* masks = &renderer.glyph_cache[renderer.glyph_cache_next];
+  renderer.glyph_cache_next = (renderer.glyph_cache_next + 1) % GLYPH_CACHE_SIZE;
+  masks->glyphs = font->glyphs;
+  masks->size = size;
+  masks->width = width;
+  // glyph pixel gx covers the same pixels as the rect that it was drawn with before: size pixels from gx * size
+  const u64 pixel_mask = pixel_size >= 64 ? ~0ull : (1ull << pixel_size) - 1;
+  for (i32 code = 0; code < font->count; ++code) {
+    const u8* glyph = &font->glyphs[code * font->width * font->height];
+    for (i32 gy = 0; gy < font->height; ++gy) {
+      u64 row = 0;
+      for (i32 gx = 0; gx < font->width; ++gx) {
+        if (glyph[gy * font->width + gx]) {
+          row |= pixel_mask << (i32)(gx * size);
+        }
+      }
+      masks->rows[code][gy] = row;
+    }
+  }
+  return masks;
+}
+
+// all glyph pixels are white, so the tint is the color of the text
+Color text_color(Color tint) {
+  const f32 inv = 1.0f / UINT8_MAX;
+  return COLOR_RGB(
+    CLAMP((UINT8_MAX * tint.r) * inv, 0, UINT8_MAX),
+    CLAMP((UINT8_MAX * tint.g) * inv, 0, UINT8_MAX),
+    CLAMP((UINT8_MAX * tint.b) * inv, 0, UINT8_MAX)
+  );
+}
+
+// lay the text out the same way as render_text, but into the row masks of the overlay
+void overlay_rasterize(Overlay* overlay) {
+  Font font = default_font;
+  const f32 size = overlay->size;
+  const Glyph_masks* masks = glyph_masks_get(&font, size);
+  overlay->dirty = false;
+  overlay->masked = masks != NULL;
+  overlay->width = 0;
+  overlay->height = 0;
+  if (!masks) {
+    return;
+  }
+  memset(overlay->rows, 0, sizeof(overlay->rows));
+  const i32 x_spacing = 1 + font.width * size;
+  const i32 y_spacing = 1 + font.height * size;
+  const i32 pixel_size = size;
+  i32 x_offset = 0;
+  i32 y_offset = 0;
+
+  for (size_t i = 0; i < overlay->length; ++i) {
+    char code = overlay->text[i];
+    if (code == '\n') {
+      x_offset = 0;
+      y_offset += y_spacing;
+      continue;
+    }
+    if (code == ' ') {
+      x_offset += font.width;
+      continue;
+    }
+    if (code >= 0 && code < font.count) {
+      const i32 word = x_offset / 64;
+      const i32 shift = x_offset % 64;
+      for (i32 gy = 0; gy < font.height; ++gy) {
+        const u64 row = masks->rows[(i32)code][gy];
+        if (!row) {
+          continue;
+        }
+        const i32 row_y = y_offset + (i32)(gy * size);
+        for (i32 ry = row_y; ry < row_y + pixel_size && ry < OVERLAY_HEIGHT; ++ry) {
+          if (word < OVERLAY_WORDS) {
+            overlay->rows[ry][word] |= row << shift;
+          }
+          if (shift && word + 1 < OVERLAY_WORDS) {
+            overlay->rows[ry][word + 1] |= row >> (64 - shift);
+          }
+          overlay->height = MAX(overlay->height, ry + 1);
+        }
+        overlay->width = MAX(overlay->width, x_offset + masks->width);
+      }
+    }
+    x_offset += x_spacing;
+  }
+  overlay->width = MIN(overlay->width, OVERLAY_WORDS * 64);
+}
+
+// draw the overlays over the frame, a masked blit of each of their row words that has any pixels set
+void overlays_composite(void) {
+  for (u32 i = 0; i < renderer.overlay_count; ++i) {
+    Overlay* overlay = &renderer.overlays[i];
+    if (!overlay->length) {
+      continue;
+    }
+    if (overlay->dirty) {
+      overlay_rasterize(overlay);
+    }
+    if (!overlay->masked) {
+      render_text(overlay->text, overlay->length, overlay->x, overlay->y, overlay->size, overlay->tint);
+      continue;
+    }
+    const Color color = text_color(overlay->tint);
+    const i32 words = (overlay->width + 63) / 64;
+    for (i32 y = 0; y < overlay->height; ++y) {
+      for (i32 word = 0; word < words; ++word) {
+        const u64 mask = overlay->rows[y][word];
+        if (mask) {
+          render_row_mask(overlay->x + word * 64, overlay->y + y, mask, color);
+        }
+      }
+    }
+  }
+}
+
+// draw color to the pixels of row y, from x, where the bits of mask are set
+void render_row_mask(i32 x, i32 y, u64 mask, Color color) {
+  if (y < 0 || y >= renderer.height || x >= renderer.width || x <= -64) {
+    return;
+  }
+  if (x < 0) {
+    mask >>= -x;
+    x = 0;
+  }
+  const i32 count = renderer.width - x;
+  if (count < 64) {
+    mask &= (1ull << count) - 1;
+  }
+#if defined(USE_SSE) && !defined(TILED_FRAMEBUFFER)
+  if (renderer.blend_mode == BLEND_NONE) {
+    // four pixels at a time, with the bits of the mask spread into a lane mask for the blend
+    Color* row = get_pixel_addr(x, y);
+    const __m128i c = _mm_set1_epi32(color.value);
+    const __m128i bits = _mm_setr_epi32(1, 2, 4, 8);
+    i32 i = 0;
+    for (; mask && i + 4 <= count; i += 4, mask >>= 4) {
+      if (!(mask & 0xf)) {
+        continue;
+      }
+      const __m128i lanes = _mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(mask & 0xf), bits), bits);
+      const __m128i pixels = _mm_loadu_si128((const __m128i*)&row[i]);
+      _mm_storeu_si128((__m128i*)&row[i], _mm_or_si128(_mm_and_si128(lanes, c), _mm_andnot_si128(lanes, pixels)));
+    }
+    x += i;
+  }
+#endif
+  while (mask) {
+    const i32 i = __builtin_ctzll(mask);
+    draw_pixel(get_pixel_addr(x + i, y), color);
+    mask &= mask - 1;
+  }
+}
+
 void renderer_set_clear_color(Color color) {
-  for (i32 i = 0; i < renderer.width * renderer.height; ++i) {
-    renderer.clear_buffer[i] = color;
-  } 
+  const i32 bands = band_count();
+  i32 band = 0;
+
+  #pragma omp parallel for
+  for (band = 0; band < bands; ++band) {
+    const Rect rect = band_rect(band);
+    for (i32 i = rect.y1 * renderer.width; i < rect.y2 * renderer.width; ++i) {
+      renderer.clear_buffer[i] = color;
+    }
+  }
+}
+
+// a new overlay without any text, -1 if there is no room for more
+i32 renderer_create_overlay(void) {
+  if (renderer.overlay_count >= MAX_OVERLAYS) {
+    return -1;
+  }
+  const i32 index = renderer.overlay_count++;
+  memset(&renderer.overlays[index], 0, sizeof(Overlay));
+  return index;
+}
+
+// set what the overlay shows from now on. the text is only rasterized again if it or its size changed
+void renderer_set_overlay_text(i32 index, const char* text, size_t length, i32 x, i32 y, f32 size, Color tint) {
+  if (index < 0 || index >= (i32)renderer.overlay_count) {
+    return;
+  }
+  Overlay* overlay = &renderer.overlays[index];
+  length = MIN(length, MAX_OVERLAY_TEXT);
+  if (length != overlay->length || size != overlay->size || memcmp(text, overlay->text, length) != 0) {
+    memcpy(overlay->text, text, length);
+    overlay->length = length;
+    overlay->size = size;
+    overlay->dirty = true;
+  }
+  overlay->x = x;
+  overlay->y = y;
+  overlay->tint = tint;
 }
 
 void renderer_begin_frame(f32 dt) {
+  // rebuilt here rather than in the post processing, which can run on several threads at once
+  if (renderer.fog_lut_density != FOG_DENSITY) {
+    fog_lut_build(FOG_DENSITY);
+  }
+  if (renderer.dither_size != DITHER_SIZE || memcmp(renderer.dither_bits, DITHER_BITS, sizeof(renderer.dither_bits)) != 0) {
+    dither_build(DITHER_SIZE, DITHER_BITS);
+  }
   renderer.num_primitives = 0;
   renderer.num_primitives_culled = 0;
+  renderer.num_fragments = 0;
 #ifndef NO_RENDER_COMMANDS
   renderer.render_command_count = 0;
   renderer.render_texture_count = 0;
 #endif
+  renderer.light_count = 0;
+  renderer.ambience = LIGHT_AMBIENCE;
+  memset(renderer.light_tile_mask, 0, sizeof(renderer.light_tile_mask));
+  renderer.shadow_map_count = 0;
+  renderer.shadow_texel_count = 0;
+  renderer.draw_count = 0;
   renderer.dt = dt;
 }
 
+// add a light to the frame, and mark the screen tiles within its range so that triangles only evaluate the lights that reach them.
+// the tiles are found with the current camera, so lights have to be pushed after the camera is updated,
+// and meshes only test the lights pushed before them
+void renderer_push_light(Light light) {
+  Rect rect = {0};
+  renderer.ambience = MAX(renderer.ambience, light.ambience);
+  if (renderer.light_count >= MAX_LIGHTS) {
+    return;
+  }
+  const f32 range = light_get_range(light);
+  v3 bounds_center = light.pos;
+  f32 bounds_radius = range;
+  light_get_bounds(&light, range, &bounds_center, &bounds_radius);
+  if (range <= 0 || !sphere_screen_rect(bounds_center, bounds_radius, &rect)) {
+    return;
+  }
+  const u32 index = renderer.light_count++;
+  const u64 bit = (u64)1 << index;
+  const i32 tiles_x = (renderer.width + TILE_SIZE - 1) / TILE_SIZE;
+  renderer.lights[index] = light;
+  renderer.light_range[index] = range;
+  renderer.light_shadow_map[index] = -1;
+#ifndef NO_RENDER_COMMANDS
+  // immediate mode draws are lit before the shadow casters are known
+  if (light.shadow_size > 0) {
+    shadow_map_create(index, &light, range);
+  }
+#endif
+  for (i32 ty = rect.y1 / TILE_SIZE; ty <= (rect.y2 - 1) / TILE_SIZE; ++ty) {
+    for (i32 tx = rect.x1 / TILE_SIZE; tx <= (rect.x2 - 1) / TILE_SIZE; ++tx) {
+      renderer.light_tile_mask[ty * tiles_x + tx] |= bit;
+    }
+  }
+}
+
 void renderer_draw(void) {
+  renderer.post_processed = false;
 #ifndef NO_RENDER_COMMANDS
+  render_shadow_maps();
+  if (renderer.tile_rendering && bin_render_commands()) {
+    render_tiles();
+    renderer.clear_pending = false;
+    // the low resolution effects need the whole frame, so then all post processing is left for afterwards
+    renderer.post_processed = !low_res_effects();
+    return;
+  }
+  if (renderer.clear_pending) {
+    clear_buffers();
+  }
   process_render_commands();
 #endif
 }
 
-void renderer_post_process(void) {
+void post_process_rect(const Raster_target* rt, Rect rect) {
+  const Color fog_color = FOG_COLOR; // COLOR_RGB(210, 210, 230);
+  const u32 low_res = low_res_effects();
+  const bool edge_detection = renderer.edge_detection && !(low_res & (1 << LOW_RES_EDGE_DETECTION));
+  Color colors[POST_PROCESS_SPAN];
+  i32 indices[POST_PROCESS_SPAN];
+  u16 edge_weights[POST_PROCESS_SPAN];
+  u16 fog_weights[POST_PROCESS_SPAN];
+  u16 low_res_weights[MAX_LOW_RES_EFFECT][POST_PROCESS_SPAN];
+  Blend_layer layers[2 + MAX_LOW_RES_EFFECT];
+  i32 layer_count = 0;
+  if (edge_detection) {
+    layers[layer_count++] = (Blend_layer) { .weights = edge_weights, .color = EDGE_DETECTION_COLOR, };
+  }
+  for (i32 effect = 0; effect < MAX_LOW_RES_EFFECT; ++effect) {
+    if (low_res & (1 << effect)) {
+      layers[layer_count++] = (Blend_layer) { .weights = low_res_weights[effect], .color = low_res_effect_color(effect), };
+    }
+  }
+  const bool fog = renderer.fog && !renderer.vertex_fog;
+  if (fog) {
+    layers[layer_count++] = (Blend_layer) { .weights = fog_weights, .color = fog_color, };
+  }
+  if (layer_count == 0) {
+    return;
+  }
+
+  for (i32 y = rect.y1; y < rect.y2; ++y) {
+    for (i32 x1 = rect.x1; x1 < rect.x2; x1 += POST_PROCESS_SPAN) {
+      const i32 count = MIN(rect.x2 - x1, POST_PROCESS_SPAN);
+      i32 index = target_index(rt, x1, y);
+      for (i32 i = 0; i < count; index = target_index_next(rt, index, x1 + i), ++i) {
+        indices[i] = index;
+        colors[i] = rt->color[index];
+      }
+      if (edge_detection) {
+        for (i32 i = 0; i < count; ++i) {
+          edge_weights[i] = edge_weight(rt, x1 + i, y, indices[i]);
+        }
+      }
+      if (low_res) {
+        low_res_upsample(rt, x1, y, count, indices, low_res, low_res_weights);
+      }
+      if (fog) {
+        for (i32 i = 0; i < count; ++i) {
+          fog_weights[i] = fog_at_depth(rt->zbuffer[indices[i]]);
+        }
+      }
+      color_blend_span(colors, count, layers, layer_count);
+      for (i32 i = 0; i < count; ++i) {
+        rt->color[indices[i]] = colors[i];
+      }
+    }
+  }
+}
+
+// edge weight of pixel (x, y), found from the normal buffer or the depth buffer
+u16 edge_weight(const Raster_target* rt, i32 x, i32 y, i32 index) {
 #ifndef NO_NORMAL_BUFFER
-  if (renderer.edge_detection) {
-    f32 normalization_factor = 1.0f / UINT8_MAX;
-    for (i32 y = 0; y < renderer.height; ++y) {
-      for (i32 x = 0; x < renderer.width; ++x) {
-        Color* target = get_pixel_addr(x, y);
-        Color* sample = get_pixel_addr_from_buffer(renderer.normal_buffer, x, y);
-        f32 f = 0;
-        f32 sample_count = 0;
-        v3 sample_v = V3_OP1(V3(sample->r, sample->g, sample->b), normalization_factor, *);
-        // (1+c)*0.5
-        sample_v = V3_OP1(sample_v, 0.5f, -);
-        sample_v = V3_OP1(sample_v, 2, *);
-        for (i32 sy = -1; sy < 1; ++sy) {
-          for (i32 sx = -1; sx < 1; ++sx) {
-            Color* n = get_pixel_addr_bounds_checked(renderer.normal_buffer, x + sx, y + sy);
-            if ((sx == 0 && sy == 0) || !n) {
-              continue;
-            }
-            v3 n_v = V3_OP1(V3(n->r, n->g, n->b), normalization_factor, *);
-            n_v = V3_OP1(n_v, 0.5f, -);
-            n_v = V3_OP1(n_v, 2, *);
-            f += v3_dot(n_v, sample_v);
-            sample_count += 1;
-          }
+  if (!renderer.edge_detection_depth) {
+    const f32 normalization_factor = 1.0f / UINT8_MAX;
+    Color* sample = &rt->normal_buffer[index];
+    f32 f = 0;
+    f32 sample_count = 0;
+    v3 sample_v = V3_OP1(V3(sample->r, sample->g, sample->b), normalization_factor, *);
+    // (1+c)*0.5
+    sample_v = V3_OP1(sample_v, 0.5f, -);
+    sample_v = V3_OP1(sample_v, 2, *);
+    for (i32 sy = -1; sy < 1; ++sy) {
+      for (i32 sx = -1; sx < 1; ++sx) {
+        if ((sx == 0 && sy == 0) || !fb_bounds_check(x + sx, y + sy)) {
+          continue;
         }
-        f *= 1.0f / sample_count;
-        *target = color_lerp(*target, EDGE_DETECTION_COLOR, 1-f);
+        Color* n = &rt->normal_buffer[target_index(rt, x + sx, y + sy)];
+        v3 n_v = V3_OP1(V3(n->r, n->g, n->b), normalization_factor, *);
+        n_v = V3_OP1(n_v, 0.5f, -);
+        n_v = V3_OP1(n_v, 2, *);
+        f += v3_dot(n_v, sample_v);
+        sample_count += 1;
       }
     }
+    f *= 1.0f / sample_count;
+    return CLAMP(1 - f, 0, 1) * BLEND_ONE;
   }
 #endif
+  return depth_edge_weight(rt, x, y, rt->zbuffer[index]);
+}
 
-  if (renderer.fog) {
-    Color fog_color = FOG_COLOR; // COLOR_RGB(210, 210, 230);
-    // f(x) = 1 / (ax * bx * cx);
-    f32 falloff_a = 500;
-    f32 falloff_b = 150;
-    f32 falloff_c = 4;
-    for (i32 y = 0; y < renderer.height; ++y) {
-      for (i32 x = 0; x < renderer.width; ++x) {
-        Color* color = get_pixel_addr(x, y);
-        f32 z = 1 - get_zbuffer_value(x, y);
-        f32 z_adjusted = CLAMP(1.0f / (1.0f + (falloff_a * z * falloff_b * z * falloff_c * z)), 0.0f, 1.0f);
-        *color = color_lerp(*color, fog_color, z_adjusted);
+// edge weight of pixel (x, y) at depth z, from the second differences of the depth across the pixel, each relative to the depth gradient.
+// the projected depth varies linearly across a plane in screen space, so the second differences are zero within a face,
+// and only creases and silhouettes are found. neighbours outside of the screen leave out that axis
+u16 depth_edge_weight(const Raster_target* rt, i32 x, i32 y, f32 z) {
+  f32 edge = 0;
+  for (i32 axis = 0; axis < 2; ++axis) {
+    const i32 dx = axis == 0;
+    const i32 dy = axis == 1;
+    if (!fb_bounds_check(x - dx, y - dy) || !fb_bounds_check(x + dx, y + dy)) {
+      continue;
+    }
+    const f32 prev = rt->zbuffer[target_index(rt, x - dx, y - dy)];
+    const f32 next = rt->zbuffer[target_index(rt, x + dx, y + dy)];
+    const f32 second = ABS(f32, prev + next - 2 * z);
+    const f32 gradient = ABS(f32, next - prev);
+    edge = MAX(edge, second / (gradient + EPS));
+  }
+  return edge > EDGE_DEPTH_THRESHOLD ? BLEND_ONE : 0;
+}
+
+// view space distance of a depth buffer value, the inverse of the depth mapping of the projection in camera.c
+inline f32 linear_depth(f32 z) {
+  return (CAMERA_ZNEAR * CAMERA_ZFAR) / (CAMERA_ZNEAR + CAMERA_ZFAR - z * (CAMERA_ZFAR - CAMERA_ZNEAR));
+}
+
+// screen space ambient occlusion of pixel (x, y) at depth z, from the depth buffer alone.
+// pairs of samples on opposite sides of the pixel are compared with it. 1/depth is linear in screen space across a plane,
+// so the pair meets at the depth of the pixel on a flat surface, and in front of it in creases and corners.
+// how far in front, relative to the depth difference between the two samples, is how occluded the pixel is by that pair.
+// pairs that meet further in front of the pixel than the radius fade out, as they are likely to be on separate objects
+u16 ambient_occlusion_weight(const Raster_target* rt, i32 x, i32 y, f32 z) {
+  if (z >= 1.0f) {
+    return 0;
+  }
+  const f32 radius = AMBIENT_OCCLUSION_RADIUS;
+  const f32 depth = linear_depth(z);
+  const f32 pixels = CLAMP(radius * projection.e[1][1] * renderer.height * 0.5f / depth, 1.0f, AMBIENT_OCCLUSION_MAX_PIXELS);
+  // half of a circle in steps of 1/8, every other one used by every other pixel, which the upsampling smooths out
+  static const v2 directions[2 * AMBIENT_OCCLUSION_PAIRS] = {
+    { 1.0f, 0.0f }, { 0.9239f, 0.3827f }, { 0.7071f, 0.7071f }, { 0.3827f, 0.9239f },
+    { 0.0f, 1.0f }, { -0.3827f, 0.9239f }, { -0.7071f, 0.7071f }, { -0.9239f, 0.3827f },
+  };
+  const i32 rotation = (x ^ y) & 1;
+  f32 occlusion = 0;
+  i32 pair_count = 0;
+  for (i32 pair = 0; pair < AMBIENT_OCCLUSION_PAIRS; ++pair) {
+    const v2 direction = directions[2 * pair + rotation];
+    const f32 distance = (pair & 1) ? pixels : pixels * 0.5f;
+    const i32 dx = (i32)(direction.x * distance);
+    const i32 dy = (i32)(direction.y * distance);
+    if (!fb_bounds_check(x - dx, y - dy) || !fb_bounds_check(x + dx, y + dy)) {
+      continue;
+    }
+    const f32 a = linear_depth(rt->zbuffer[target_index(rt, x - dx, y - dy)]);
+    const f32 b = linear_depth(rt->zbuffer[target_index(rt, x + dx, y + dy)]);
+    const f32 middle = 2.0f / (1.0f / a + 1.0f / b);
+    const f32 fold = CLAMP((depth - middle) / (0.5f * ABS(f32, a - b) + 0.05f * radius), 0.0f, 1.0f);
+    const f32 range = CLAMP(2.0f - (depth - middle) / radius, 0.0f, 1.0f);
+    occlusion += fold * range;
+    pair_count += 1;
+  }
+  if (pair_count == 0) {
+    return 0;
+  }
+  return CLAMP(AMBIENT_OCCLUSION_STRENGTH * occlusion / pair_count, 0.0f, 1.0f) * BLEND_ONE;
+}
+
+// bit mask of the Low_res_effect that are enabled
+inline u32 low_res_effects(void) {
+  u32 effects = 0;
+  if (renderer.edge_detection && renderer.edge_detection_low_res) {
+    effects |= 1 << LOW_RES_EDGE_DETECTION;
+  }
+  if (renderer.ambient_occlusion) {
+    effects |= 1 << LOW_RES_AMBIENT_OCCLUSION;
+  }
+  return effects;
+}
+
+inline Color low_res_effect_color(i32 effect) {
+  switch (effect) {
+    case LOW_RES_EDGE_DETECTION:
+      return EDGE_DETECTION_COLOR;
+    default:
+      return COLOR_RGB(0, 0, 0);
+  }
+}
+
+// the effects are evaluated at the center pixel of every low_res_scale x low_res_scale block of the frame
+void low_res_render(const Raster_target* rt, u32 effects) {
+  const i32 scale = renderer.low_res_scale;
+  renderer.low_res_width = (renderer.width + scale - 1) / scale;
+  renderer.low_res_height = (renderer.height + scale - 1) / scale;
+  i32 ly = 0;
+
+  #pragma omp parallel for
+  for (ly = 0; ly < renderer.low_res_height; ++ly) {
+    const i32 y = MIN(ly * scale + scale / 2, renderer.height - 1);
+    for (i32 lx = 0; lx < renderer.low_res_width; ++lx) {
+      const i32 x = MIN(lx * scale + scale / 2, renderer.width - 1);
+      const i32 sample = ly * renderer.low_res_width + lx;
+      const i32 index = target_index(rt, x, y);
+      const f32 z = rt->zbuffer[index];
+      renderer.low_res_depth[sample] = linear_depth(z);
+      if (effects & (1 << LOW_RES_EDGE_DETECTION)) {
+        renderer.low_res_weights[LOW_RES_EDGE_DETECTION][sample] = edge_weight(rt, x, y, index);
+      }
+      if (effects & (1 << LOW_RES_AMBIENT_OCCLUSION)) {
+        renderer.low_res_weights[LOW_RES_AMBIENT_OCCLUSION][sample] = ambient_occlusion_weight(rt, x, y, z);
       }
     }
   }
-  if (renderer.dither) {
-    for (i32 y = 0; y < renderer.height; ++y) {
-      for (i32 x = 0; x < renderer.width; ++x) {
-        Color* color = get_pixel_addr(x, y);
-        u8 d = (x % 2) * (y % 2);
-        color->r -= (color->r * 0.1f) * d;
-        color->g -= (color->g * 0.1f) * d;
-        color->b -= (color->b * 0.1f) * d;
+}
+
+// depth aware (bilateral) upsampling of the low resolution effects, for a span of pixels starting at (x1, y).
+// the four nearest samples are weighted bilinearly, and by how close their depth is to that of the pixel,
+// so that the effects don't bleed across silhouettes
+void low_res_upsample(const Raster_target* rt, i32 x1, i32 y, i32 count, const i32* indices, u32 effects, u16 weights[MAX_LOW_RES_EFFECT][POST_PROCESS_SPAN]) {
+  const i32 scale = renderer.low_res_scale;
+  const i32 width = renderer.low_res_width;
+  const f32 inv_scale = 1.0f / scale;
+  const f32 v = (y - scale / 2) * inv_scale;
+  const i32 ly = (i32)floorf(v);
+  const f32 fy = v - ly;
+  const i32 rows[2] = { CLAMP(ly, 0, renderer.low_res_height - 1) * width, CLAMP(ly + 1, 0, renderer.low_res_height - 1) * width, };
+  for (i32 i = 0; i < count; ++i) {
+    const f32 u = (x1 + i - scale / 2) * inv_scale;
+    const i32 lx = (i32)floorf(u);
+    const f32 fx = u - lx;
+    const i32 columns[2] = { CLAMP(lx, 0, width - 1), CLAMP(lx + 1, 0, width - 1), };
+    i32 samples[4];
+    for (i32 s = 0; s < 4; ++s) {
+      samples[s] = rows[s >> 1] + columns[s & 1];
+    }
+    // most of the frame is the same for all four samples (usually no effect at all), which needs no filtering
+    bool uniform = true;
+    for (i32 effect = 0; effect < MAX_LOW_RES_EFFECT && uniform; ++effect) {
+      if (effects & (1 << effect)) {
+        const u16* effect_weights = renderer.low_res_weights[effect];
+        const u16 w = effect_weights[samples[0]];
+        uniform = effect_weights[samples[1]] == w && effect_weights[samples[2]] == w && effect_weights[samples[3]] == w;
       }
     }
+    if (uniform) {
+      for (i32 effect = 0; effect < MAX_LOW_RES_EFFECT; ++effect) {
+        if (effects & (1 << effect)) {
+          weights[effect][i] = renderer.low_res_weights[effect][samples[0]];
+        }
+      }
+      continue;
+    }
+    const f32 depth = linear_depth(rt->zbuffer[indices[i]]);
+    const f32 inv_depth = 1.0f / depth;
+    f32 sample_weights[4];
+    f32 total = 0;
+    for (i32 s = 0; s < 4; ++s) {
+      const f32 bilinear = ((s & 1) ? fx : 1 - fx) * ((s >> 1) ? fy : 1 - fy);
+      sample_weights[s] = bilinear / (LOW_RES_DEPTH_TOLERANCE + ABS(f32, renderer.low_res_depth[samples[s]] - depth) * inv_depth);
+      total += sample_weights[s];
+    }
+    const f32 normalization = 1.0f / total;
+    for (i32 effect = 0; effect < MAX_LOW_RES_EFFECT; ++effect) {
+      if (!(effects & (1 << effect))) {
+        continue;
+      }
+      const u16* effect_weights = renderer.low_res_weights[effect];
+      f32 weight = 0;
+      for (i32 s = 0; s < 4; ++s) {
+        weight += sample_weights[s] * effect_weights[samples[s]];
+      }
+      weights[effect][i] = weight * normalization;
+    }
+  }
+}
+
+// fog weight at each of the FOG_LUT_SIZE + 1 evenly spaced depths from the near (0) to the far (1) plane
+void fog_lut_build(f32 density) {
+  for (i32 i = 0; i <= FOG_LUT_SIZE; ++i) {
+    const f32 d = 1 - (f32)i / FOG_LUT_SIZE;
+    const f32 fog = CLAMP(1.0f / (1.0f + density * d * d * d), 0.0f, 1.0f);
+    renderer.fog_lut[i] = fog * BLEND_ONE;
+  }
+  renderer.fog_lut_density = density;
+}
+
+inline u16 fog_at_depth(f32 z) {
+  return renderer.fog_lut[(i32)(CLAMP(z, 0.0f, 1.0f) * FOG_LUT_SIZE)];
+}
+
+// the clear color, which with per vertex fog is fogged by the clear depth, as no triangle will fog it
+inline Color clear_color_at(i32 index) {
+  if (renderer.fog && renderer.vertex_fog) {
+    return color_blend(renderer.clear_buffer[index], FOG_COLOR, fog_at_depth(renderer.clear_zbuffer[index]));
+  }
+  return renderer.clear_buffer[index];
+}
+
+// two channels per word, each in its own 16 bit lane
+inline Color color_blend(Color color, Color target, u32 weight) {
+  const u32 rb = (color.value & 0x00ff00ff) * (BLEND_ONE - weight) + (target.value & 0x00ff00ff) * weight;
+  const u32 ga = ((color.value >> 8) & 0x00ff00ff) * (BLEND_ONE - weight) + ((target.value >> 8) & 0x00ff00ff) * weight;
+  return (Color) { .value = ((rb >> BLEND_BITS) & 0x00ff00ff) | (ga & 0xff00ff00) };
+}
+
+// ordered dithering with a bayer matrix. the bias of each matrix position is spread evenly over one quantization step of each channel,
+// so that quantizing (truncating) the biased colors keeps the average color of an area
+void dither_build(i32 size, const u8* bits) {
+  ASSERT(size == 2 || size == 4 || size == 8);
+  const i32 size_log2 = size == 2 ? 1 : size == 4 ? 2 : 3;
+  renderer.dither_mask = COLOR_RGBA(0, 0, 0, 255);
+  for (i32 channel = 0; channel < 3; ++channel) {
+    ASSERT(bits[channel] >= 1 && bits[channel] <= 8);
+    ((u8*)&renderer.dither_mask)[channel] = (0xff << (8 - bits[channel])) & 0xff;
+    // sum of 2^(16 - bits * n) for every shift that leaves some of the kept bits, which don't overlap between shifts
+    u32 repeat = 0;
+    for (i32 shift = bits[channel]; shift < 8; shift += bits[channel]) {
+      repeat += 1 << (16 - shift);
+    }
+    renderer.dither_repeat[channel] = repeat;
+  }
+  for (i32 y = 0; y < DITHER_MAX_SIZE; ++y) {
+    for (i32 x = 0; x < DITHER_MAX_SIZE; ++x) {
+      // interleave the bits of (x ^ y) and y, with the lowest bits the most significant
+      i32 m = 0;
+      for (i32 bit = 0; bit < size_log2; ++bit) {
+        const i32 xb = (x >> bit) & 1;
+        const i32 yb = (y >> bit) & 1;
+        m = (m << 2) | ((xb ^ yb) << 1) | yb;
+      }
+      Color bias = COLOR_RGBA(0, 0, 0, 0);
+      for (i32 channel = 0; channel < 3; ++channel) {
+        const i32 step = 1 << (8 - bits[channel]);
+        ((u8*)&bias)[channel] = ((2 * m + 1) * step) / (2 * size * size);
+      }
+      renderer.dither_bias[y][x] = bias.value;
+    }
+  }
+  memcpy(renderer.dither_bits, bits, sizeof(renderer.dither_bits));
+  renderer.dither_size = size;
+}
+
+// quantize a row of colors starting at pixel (x, y), with x a multiple of four.
+// the kept bits of each channel are repeated until they fill the ones that were cut off, so that full intensity stays at 255
+void dither_span(Color* colors, i32 count, i32 x, i32 y) {
+  const u32* bias = renderer.dither_bias[y & DITHER_MASK];
+  const u16* repeat = renderer.dither_repeat;
+  i32 i = 0;
+#ifdef USE_SSE
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i mask = _mm_set1_epi32(renderer.dither_mask.value);
+  // 0 for alpha, which is kept as it is
+  const __m128i repeat_lanes = _mm_setr_epi16(repeat[0], repeat[1], repeat[2], 0, repeat[0], repeat[1], repeat[2], 0);
+  for (; i + 4 <= count; i += 4) {
+    __m128i c = _mm_loadu_si128((const __m128i*)&colors[i]);
+    c = _mm_and_si128(_mm_adds_epu8(c, _mm_loadu_si128((const __m128i*)&bias[(x + i) & DITHER_MASK])), mask);
+    __m128i lo = _mm_unpacklo_epi8(c, zero);
+    __m128i hi = _mm_unpackhi_epi8(c, zero);
+    lo = _mm_add_epi16(lo, _mm_mulhi_epu16(lo, repeat_lanes));
+    hi = _mm_add_epi16(hi, _mm_mulhi_epu16(hi, repeat_lanes));
+    _mm_storeu_si128((__m128i*)&colors[i], _mm_packus_epi16(lo, hi));
+  }
+#elif defined(USE_SIMD128)
+  const v128_t mask = wasm_i32x4_splat(renderer.dither_mask.value);
+  // without a high half multiply, the 16 bit product with the multiplier shifted down by 8 is shifted down by 8 instead.
+  // the multiplier is below 256 then, so the product of an 8 bit channel fits
+  const u16 r = repeat[0] >> 8, g = repeat[1] >> 8, b = repeat[2] >> 8;
+  const v128_t repeat_lanes = wasm_u16x8_make(r, g, b, 0, r, g, b, 0);
+  for (; i + 4 <= count; i += 4) {
+    v128_t c = wasm_v128_load(&colors[i]);
+    c = wasm_v128_and(wasm_u8x16_add_sat(c, wasm_v128_load(&bias[(x + i) & DITHER_MASK])), mask);
+    v128_t lo = wasm_u16x8_extend_low_u8x16(c);
+    v128_t hi = wasm_u16x8_extend_high_u8x16(c);
+    lo = wasm_i16x8_add(lo, wasm_u16x8_shr(wasm_i16x8_mul(lo, repeat_lanes), 8));
+    hi = wasm_i16x8_add(hi, wasm_u16x8_shr(wasm_i16x8_mul(hi, repeat_lanes), 8));
+    wasm_v128_store(&colors[i], wasm_u8x16_narrow_i16x8(lo, hi));
+  }
+#endif
+  for (; i < count; ++i) {
+    u8* c = (u8*)&colors[i];
+    const u8* b = (const u8*)&bias[(x + i) & DITHER_MASK];
+    for (i32 channel = 0; channel < 3; ++channel) {
+      const u8 v = MIN(c[channel] + b[channel], UINT8_MAX) & ((u8*)&renderer.dither_mask)[channel];
+      c[channel] = v | ((v * repeat[channel]) >> 16);
+    }
+  }
+}
+
+// blend the colors towards the color of each layer in turn, by the per pixel weights of the layer.
+// the span is processed four pixels at a time, so the arrays have to hold `count` rounded up to a multiple of four
+void color_blend_span(Color* colors, i32 count, const Blend_layer* layers, i32 layer_count) {
+#ifdef USE_SSE
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i one = _mm_set1_epi16(BLEND_ONE);
+  for (i32 i = 0; i < count; i += 4) {
+    const __m128i c = _mm_loadu_si128((const __m128i*)&colors[i]);
+    // two pixels per register, with a 16 bit lane per channel
+    __m128i lo = _mm_unpacklo_epi8(c, zero);
+    __m128i hi = _mm_unpackhi_epi8(c, zero);
+    for (i32 layer_index = 0; layer_index < layer_count; ++layer_index) {
+      const Blend_layer* layer = &layers[layer_index];
+      const __m128i target = _mm_unpacklo_epi8(_mm_set1_epi32(layer->color.value), zero);
+      __m128i w = _mm_loadl_epi64((const __m128i*)&layer->weights[i]);
+      w = _mm_unpacklo_epi16(w, w);
+      const __m128i w_lo = _mm_unpacklo_epi32(w, w);
+      const __m128i w_hi = _mm_unpackhi_epi32(w, w);
+      // at most 255 * BLEND_ONE, which fits in an unsigned 16 bit lane
+      lo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(lo, _mm_sub_epi16(one, w_lo)), _mm_mullo_epi16(target, w_lo)), BLEND_BITS);
+      hi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(hi, _mm_sub_epi16(one, w_hi)), _mm_mullo_epi16(target, w_hi)), BLEND_BITS);
+    }
+    _mm_storeu_si128((__m128i*)&colors[i], _mm_packus_epi16(lo, hi));
+  }
+#elif defined(USE_SIMD128)
+  const v128_t one = wasm_i16x8_splat(BLEND_ONE);
+  for (i32 i = 0; i < count; i += 4) {
+    const v128_t c = wasm_v128_load(&colors[i]);
+    v128_t lo = wasm_u16x8_extend_low_u8x16(c);
+    v128_t hi = wasm_u16x8_extend_high_u8x16(c);
+    for (i32 layer_index = 0; layer_index < layer_count; ++layer_index) {
+      const Blend_layer* layer = &layers[layer_index];
+      const v128_t target = wasm_u16x8_extend_low_u8x16(wasm_i32x4_splat(layer->color.value));
+      const v128_t w = wasm_v128_load64_zero(&layer->weights[i]);
+      const v128_t w_lo = wasm_i16x8_shuffle(w, w, 0, 0, 0, 0, 1, 1, 1, 1);
+      const v128_t w_hi = wasm_i16x8_shuffle(w, w, 2, 2, 2, 2, 3, 3, 3, 3);
+      lo = wasm_u16x8_shr(wasm_i16x8_add(wasm_i16x8_mul(lo, wasm_i16x8_sub(one, w_lo)), wasm_i16x8_mul(target, w_lo)), BLEND_BITS);
+      hi = wasm_u16x8_shr(wasm_i16x8_add(wasm_i16x8_mul(hi, wasm_i16x8_sub(one, w_hi)), wasm_i16x8_mul(target, w_hi)), BLEND_BITS);
+    }
+    wasm_v128_store(&colors[i], wasm_u8x16_narrow_i16x8(lo, hi));
+  }
+#else
+  for (i32 layer_index = 0; layer_index < layer_count; ++layer_index) {
+    const Blend_layer* layer = &layers[layer_index];
+    for (i32 i = 0; i < count; ++i) {
+      colors[i] = color_blend(colors[i], layer->color, layer->weights[i]);
+    }
+  }
+#endif
+}
+
+// all enabled effects are applied in a single pass over the framebuffer, a band at a time.
+// edge detection reads the normals of the row above, across the edge of the band, which is fine as only colors are written
+void renderer_post_process(void) {
+  if (renderer.post_processed) {
+    return;
+  }
+  const u32 low_res = low_res_effects();
+  if (!renderer.edge_detection && !(renderer.fog && !renderer.vertex_fog) && !low_res) {
+    return;
+  }
+  const Raster_target rt = main_raster_target();
+  const i32 bands = band_count();
+  i32 band = 0;
+  if (low_res) {
+    low_res_render(&rt, low_res);
+  }
+
+  #pragma omp parallel for
+  for (band = 0; band < bands; ++band) {
+    post_process_rect(&rt, band_rect(band));
   }
 }
 
 void renderer_end_frame(void) {
+  const i32 bands = band_count();
+  i32 band = 0;
   if (renderer.render_zbuffer) {
-    for (i32 y = 0; y < renderer.height; ++y) {
-      for (i32 x = 0; x < renderer.width; ++x) {
-        Color* color = get_pixel_addr(x, y);
-        f32 z = *get_zbuffer_addr(x, y);
-        u8 c = UINT8_MAX * (z * z * z * z);
-        *color = COLOR_RGB(c, c, c);
+    #pragma omp parallel for
+    for (band = 0; band < bands; ++band) {
+      const Rect rect = band_rect(band);
+      for (i32 i = rect.y1 * renderer.width; i < rect.y2 * renderer.width; ++i) {
+        const f32 z = renderer.zbuffer_target[i];
+        const u8 c = UINT8_MAX * (z * z * z * z);
+        renderer.target[i] = COLOR_RGB(c, c, c);
       }
     }
   }
 #ifndef NO_NORMAL_BUFFER
   else if (renderer.render_normal_buffer) {
-    for (i32 y = 0; y < renderer.height; ++y) {
-      for (i32 x = 0; x < renderer.width; ++x) {
-        Color* color = get_pixel_addr(x, y);
-        Color* normal = get_pixel_addr_from_buffer(renderer.normal_buffer, x, y);
-        *color = *normal;
+    #pragma omp parallel for
+    for (band = 0; band < bands; ++band) {
+      const Rect rect = band_rect(band);
+      const i32 first = rect.y1 * renderer.width;
+      memcpy(&renderer.target[first], &renderer.normal_buffer[first], sizeof(Color) * (rect.y2 - rect.y1) * renderer.width);
+    }
+  }
+#endif
+  overlays_composite();
+  // dithering is the last stage, after anything else has been drawn
+  if (renderer.dither) {
+    #pragma omp parallel for
+    for (band = 0; band < bands; ++band) {
+      const Rect rect = band_rect(band);
+      for (i32 y = rect.y1; y < rect.y2; ++y) {
+#ifdef TILED_FRAMEBUFFER
+        // a row of a block at a time
+        for (i32 x = 0; x < renderer.width; x += FB_BLOCK_SIZE) {
+          dither_span(&renderer.target[pixel_index(x, y)], FB_BLOCK_SIZE, x, y);
+        }
+#else
+        dither_span(&renderer.target[pixel_index(0, y)], renderer.width, 0, y);
+#endif
       }
     }
   }
+#ifdef TILED_FRAMEBUFFER
+  resolve_framebuffer(renderer.display_buffer, renderer.color_buffer);
 #endif
 }
 
 void renderer_clear(void) {
-  memcpy(renderer.color_buffer, renderer.clear_buffer, sizeof(Color) * renderer.width * renderer.height);
-  memcpy(renderer.zbuffer_target, renderer.clear_zbuffer, sizeof(f32) * renderer.width * renderer.height);
+#ifndef NO_RENDER_COMMANDS
+  if (renderer.tile_rendering) {
+    // tiles are cleared one by one while they are rendered
+    renderer.clear_pending = true;
+    return;
+  }
+#endif
+  clear_buffers();
+}
+
+void clear_buffers(void) {
+  renderer.clear_pending = false;
+  const bool fogged = renderer.fog && renderer.vertex_fog;
+  const i32 bands = band_count();
+  i32 band = 0;
+
+  #pragma omp parallel for
+  for (band = 0; band < bands; ++band) {
+    const Rect rect = band_rect(band);
+    const i32 first = rect.y1 * renderer.width;
+    const i32 count = (rect.y2 - rect.y1) * renderer.width;
+    if (fogged) {
+      for (i32 i = first; i < first + count; ++i) {
+        renderer.color_buffer[i] = clear_color_at(i);
+      }
+    }
+    else {
+      memcpy(&renderer.color_buffer[first], &renderer.clear_buffer[first], sizeof(Color) * count);
+    }
+    memcpy(&renderer.zbuffer_target[first], &renderer.clear_zbuffer[first], sizeof(f32) * count);
 #ifndef NO_NORMAL_BUFFER
-  memcpy(&renderer.normal_buffer[0], &renderer.clear_normal_buffer[0], sizeof(Color) * renderer.width * renderer.height);
+    memcpy(&renderer.normal_buffer[first], &renderer.clear_normal_buffer[first], sizeof(Color) * count);
 #endif
+  }
 }
 
 i32 renderer_get_num_primitives(void) {
@@ -1206,10 +3018,30 @@ i32 renderer_get_num_primitives_culled(void) {
   return renderer.num_primitives_culled;
 }
 
+i32 renderer_get_num_fragments(void) {
+  return renderer.num_fragments;
+}
+
+i32 renderer_get_num_lights(void) {
+  return renderer.light_count;
+}
+
 void renderer_toggle_fog(void) {
   renderer.fog = !renderer.fog;
 }
 
+void renderer_toggle_vertex_fog(void) {
+  renderer.vertex_fog = !renderer.vertex_fog;
+}
+
+void renderer_toggle_ambient_occlusion(void) {
+  renderer.ambient_occlusion = !renderer.ambient_occlusion;
+}
+
+void renderer_cycle_low_res_scale(void) {
+  renderer.low_res_scale = renderer.low_res_scale >= 4 ? 1 : renderer.low_res_scale * 2;
+}
+
 void renderer_toggle_dither(void) {
   renderer.dither = !renderer.dither;
 }
@@ -1231,3 +3063,19 @@ void renderer_toggle_render_normal_buffer(void) {
 void renderer_toggle_texture_mapping(void) {
   renderer.texture_mapping = !renderer.texture_mapping;
 }
+
+void renderer_toggle_bilinear_filtering(void) {
+  renderer.bilinear_filtering = !renderer.bilinear_filtering;
+}
+
+void renderer_toggle_shadow_filtering(void) {
+  renderer.shadow_filtering = !renderer.shadow_filtering;
+}
+
+// the tiles are cleared while they are rendered, so anything drawn directly to the framebuffer before renderer_draw is
+// overwritten in tile mode. draws after it are depth tested against the tiles as in the other mode
+void renderer_toggle_tile_rendering(void) {
+#ifndef NO_RENDER_COMMANDS
+  renderer.tile_rendering = !renderer.tile_rendering;
+#endif
+}
@@ -1,6 +1,38 @@
 // texture.c
 
+// index of texel (x, y) within the block layout, where x and y are inside the texture
+inline u32 texture_swizzled_index(const Texture* const texture, const u32 x, const u32 y) {
+  const u32 shift = texture->block_shift;
+  const u32 mask = (1 << shift) - 1;
+  return
+    (y >> shift) * (texture->width << shift) +
+    ((x >> shift) << (shift * 2)) +
+    ((y & mask) << shift) +
+    (x & mask);
+}
+
+// wrapped index of texel (x, y) for any of the uncompressed layouts
+inline u32 texture_texel_index(const Texture* const texture, const u32 x, const u32 y) {
+  if (texture->flags & TEXTURE_POW2) {
+    if (texture->flags & TEXTURE_SWIZZLED) {
+      return texture_swizzled_index(texture, x & texture->width_mask, y & texture->height_mask);
+    }
+    return ((y & texture->height_mask) << texture->width_shift) + (x & texture->width_mask);
+  }
+  if (texture->flags & TEXTURE_SWIZZLED) {
+    return texture_swizzled_index(texture, x % texture->width, y % texture->height);
+  }
+  return ((y % texture->height) * texture->width) + (x % texture->width);
+}
+
 inline Color texture_get_pixel(const Texture* const texture, const i32 x, const i32 y) {
+  if (texture->format != TEXTURE_FORMAT_RGBA8 || (texture->flags & TEXTURE_SWIZZLED)) {
+    const u32 index = ((y * texture->width) + x) % (texture->width * texture->height);
+    return texture_get_sampler(texture)(texture, index % texture->width, index / texture->width);
+  }
+  if (texture->flags & TEXTURE_POW2) {
+    return texture->data[((y << texture->width_shift) + x) & ((texture->width * texture->height) - 1)];
+  }
   return texture->data[((y * texture->width) + x) % (texture->width * texture->height)];
 }
 
@@ -9,3 +41,140 @@ inline Color texture_get_pixel_wrapped(const Texture* const texture, const u32 x
   const u32 y_coord = y % texture->height;
   return texture->data[(y_coord * texture->width) + x_coord];
 }
+
+inline Color texture_get_pixel_wrapped_pow2(const Texture* const texture, const u32 x, const u32 y) {
+  const u32 x_coord = x & texture->width_mask;
+  const u32 y_coord = y & texture->height_mask;
+  return texture->data[(y_coord << texture->width_shift) + x_coord];
+}
+
+inline Color texture_get_pixel_wrapped_swizzled(const Texture* const texture, const u32 x, const u32 y) {
+  return texture->data[texture_swizzled_index(texture, x % texture->width, y % texture->height)];
+}
+
+inline Color texture_get_pixel_wrapped_pow2_swizzled(const Texture* const texture, const u32 x, const u32 y) {
+  const u32 x_coord = x & texture->width_mask;
+  const u32 y_coord = y & texture->height_mask;
+  const u32 shift = texture->block_shift;
+  const u32 mask = (1 << shift) - 1;
+  return texture->data[
+    ((y_coord >> shift) << (texture->width_shift + shift)) +
+    ((x_coord >> shift) << (shift * 2)) +
+    ((y_coord & mask) << shift) +
+    (x_coord & mask)
+  ];
+}
+
+inline Color texture_get_pixel_wrapped_palette(const Texture* const texture, const u32 x, const u32 y) {
+  return texture->palette[texture->indices[texture_texel_index(texture, x, y)]];
+}
+
+// expand an RGB565 endpoint to 8 bits per channel
+static inline Color bc1_endpoint(const u32 c) {
+  const u32 r = (c >> 11) & 0x1f;
+  const u32 g = (c >> 5) & 0x3f;
+  const u32 b = c & 0x1f;
+  return COLOR_RGB((r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2));
+}
+
+inline Color texture_get_pixel_wrapped_bc1(const Texture* const texture, const u32 x, const u32 y) {
+  const u32 x_coord = x % texture->width;
+  const u32 y_coord = y % texture->height;
+  const u32* block = &texture->blocks[(((y_coord >> 2) * (texture->width >> 2)) + (x_coord >> 2)) * 2];
+  const u32 c0 = block[0] & 0xffff;
+  const u32 c1 = block[0] >> 16;
+  const u32 selector = (block[1] >> ((((y_coord & 3) << 2) + (x_coord & 3)) * 2)) & 3;
+  const Color e0 = bc1_endpoint(c0);
+  const Color e1 = bc1_endpoint(c1);
+  switch (selector) {
+    case 0:
+      return e0;
+    case 1:
+      return e1;
+    case 2:
+      if (c0 > c1) {
+        return COLOR_RGB((2 * e0.r + e1.r) / 3, (2 * e0.g + e1.g) / 3, (2 * e0.b + e1.b) / 3);
+      }
+      return COLOR_RGB((e0.r + e1.r) / 2, (e0.g + e1.g) / 2, (e0.b + e1.b) / 2);
+    default:
+      if (c0 > c1) {
+        return COLOR_RGB((e0.r + 2 * e1.r) / 3, (e0.g + 2 * e1.g) / 3, (e0.b + 2 * e1.b) / 3);
+      }
+      return COLOR_RGBA(0, 0, 0, 0);
+  }
+}
+
+// wrapped sampler for the texture layout, to be selected once per primitive rather than per pixel
+Texture_sampler texture_get_sampler(const Texture* const texture) {
+  switch (texture->format) {
+    case TEXTURE_FORMAT_PALETTE8:
+      return texture_get_pixel_wrapped_palette;
+    case TEXTURE_FORMAT_BC1:
+      return texture_get_pixel_wrapped_bc1;
+    default:
+      break;
+  }
+  if (texture->flags & TEXTURE_SWIZZLED) {
+    if (texture->flags & TEXTURE_POW2) {
+      return texture_get_pixel_wrapped_pow2_swizzled;
+    }
+    return texture_get_pixel_wrapped_swizzled;
+  }
+  if (texture->flags & TEXTURE_POW2) {
+    return texture_get_pixel_wrapped_pow2;
+  }
+  return texture_get_pixel_wrapped;
+}
+
+// blend the 2x2 footprint around fixed point texel coordinate (u, v), fetched through the wrapped sampler
+// of the texture so that any format and layout can be filtered. the four weights sum to exactly
+// 1 << TEXTURE_SUBTEXEL_BITS, so the weighted sum of each 8 bit channel fits in 16 bits
+inline Color texture_sample_bilinear(const Texture* const texture, const Texture_sampler sample, const u32 u, const u32 v) {
+  const u32 one = 1 << TEXTURE_SUBTEXEL_BITS;
+  const u32 x = u >> TEXTURE_SUBTEXEL_BITS;
+  const u32 y = v >> TEXTURE_SUBTEXEL_BITS;
+  const u32 fx = u & (one - 1);
+  const u32 fy = v & (one - 1);
+  const u32 w11 = (fx * fy) >> TEXTURE_SUBTEXEL_BITS;
+  const u32 w10 = fx - w11;
+  const u32 w01 = fy - w11;
+  const u32 w00 = one - fx - fy + w11;
+  const Color c00 = sample(texture, x, y);
+  const Color c10 = sample(texture, x + 1, y);
+  const Color c01 = sample(texture, x, y + 1);
+  const Color c11 = sample(texture, x + 1, y + 1);
+#ifdef USE_SSE
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i top = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, c10.value, c00.value), zero);
+  const __m128i bottom = _mm_unpacklo_epi8(_mm_set_epi32(0, 0, c11.value, c01.value), zero);
+  const __m128i top_weights = _mm_set_epi16(w10, w10, w10, w10, w00, w00, w00, w00);
+  const __m128i bottom_weights = _mm_set_epi16(w11, w11, w11, w11, w01, w01, w01, w01);
+  __m128i sum = _mm_add_epi16(_mm_mullo_epi16(top, top_weights), _mm_mullo_epi16(bottom, bottom_weights));
+  sum = _mm_add_epi16(sum, _mm_srli_si128(sum, 8));
+  sum = _mm_srli_epi16(sum, TEXTURE_SUBTEXEL_BITS);
+  return (Color) { .value = (u32)_mm_cvtsi128_si32(_mm_packus_epi16(sum, sum)) };
+#else
+  // two channels per word, each in its own 16 bit lane
+  const u32 rb =
+    (c00.value & 0x00ff00ff) * w00 +
+    (c10.value & 0x00ff00ff) * w10 +
+    (c01.value & 0x00ff00ff) * w01 +
+    (c11.value & 0x00ff00ff) * w11;
+  const u32 ga =
+    ((c00.value >> 8) & 0x00ff00ff) * w00 +
+    ((c10.value >> 8) & 0x00ff00ff) * w10 +
+    ((c01.value >> 8) & 0x00ff00ff) * w01 +
+    ((c11.value >> 8) & 0x00ff00ff) * w11;
+  return (Color) { .value = ((rb >> TEXTURE_SUBTEXEL_BITS) & 0x00ff00ff) | (ga & 0xff00ff00) };
+#endif
+}
+
+// select the level where a pixel covers somewhere between one and four texels
+inline const Texture* texture_get_mip(const Texture* const texture, f32 texels_per_pixel) {
+  u32 level = 0;
+  while (texels_per_pixel >= 4.0f && level < texture->mip_count) {
+    texels_per_pixel *= 0.25f;
+    level += 1;
+  }
+  return level == 0 ? texture : &texture->mips[level - 1];
+}
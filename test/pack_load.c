@@ -0,0 +1,339 @@
+// pack_load.c
+// parsing of asset packs, which the game maps or fetches as they are without any other validation
+
+#include "common.h"
+#include "maths.h"
+#include "texture.h"
+#include "mesh.h"
+#include "pack.h"
+
+#include "pack.c"
+
+#define COMMON_IMPLEMENTATION
+#include "common.h"
+
+#define MESH_OFFSET    (sizeof(Pack_header) + 3 * sizeof(Pack_entry))
+#define MESH_SIZE      (sizeof(Pack_mesh) + 4 * sizeof(v3) + 3 * sizeof(v2) + 9 * sizeof(u32))
+#define TEXTURE_OFFSET (MESH_OFFSET + MESH_SIZE)
+#define TEXTURE_SIZE   (sizeof(Pack_texture) + sizeof(Pack_texture_level) + 4 * sizeof(Color))
+#define PALETTE_OFFSET (TEXTURE_OFFSET + TEXTURE_SIZE)
+#define PALETTE_SIZE   (sizeof(Pack_texture) + sizeof(Pack_texture_level) + 256 * sizeof(Color) + 4)
+#define PACK_SIZE      (PALETTE_OFFSET + PALETTE_SIZE)
+
+static _Alignas(PACK_ALIGNMENT) u8 pack_data[PACK_SIZE + PACK_ALIGNMENT];
+static i32 failures = 0;
+
+#define CHECK(expr) do { \
+  if (!(expr)) { \
+    printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); \
+    failures += 1; \
+  } \
+} while (0)
+
+// a pack with a triangle mesh with a normal and uvs, a 2x2 texture and a 2x2 palettized texture
+static void pack_build(u8* data) {
+  memset(data, 0, PACK_SIZE);
+  Pack_header* header = (Pack_header*)data;
+  *header = (Pack_header) { .magic = PACK_MAGIC, .version = PACK_VERSION, .entry_count = 3, .size = PACK_SIZE, };
+  Pack_entry* entries = (Pack_entry*)(data + sizeof(Pack_header));
+  entries[0] = (Pack_entry) { .name = "triangle", .type = PACK_ENTRY_MESH, .offset = MESH_OFFSET, .size = MESH_SIZE, };
+  entries[1] = (Pack_entry) { .name = "checker", .type = PACK_ENTRY_TEXTURE, .offset = TEXTURE_OFFSET, .size = TEXTURE_SIZE, };
+  entries[2] = (Pack_entry) { .name = "indexed", .type = PACK_ENTRY_TEXTURE, .offset = PALETTE_OFFSET, .size = PALETTE_SIZE, };
+
+  Pack_mesh* mesh = (Pack_mesh*)(data + MESH_OFFSET);
+  *mesh = (Pack_mesh) {
+    .type = PACK_ENTRY_MESH,
+    .vertex_count = 3,
+    .vertex_index_count = 3,
+    .normal_count = 1,
+    .normal_index_count = 3,
+    .uv_count = 3,
+    .uv_index_count = 3,
+    .vertex = sizeof(Pack_mesh),
+    .normal = sizeof(Pack_mesh) + 3 * sizeof(v3),
+    .vertex_index = sizeof(Pack_mesh) + 4 * sizeof(v3),
+    .normal_index = sizeof(Pack_mesh) + 4 * sizeof(v3) + 3 * sizeof(u32),
+    .uv = sizeof(Pack_mesh) + 4 * sizeof(v3) + 6 * sizeof(u32),
+    .uv_index = sizeof(Pack_mesh) + 4 * sizeof(v3) + 6 * sizeof(u32) + 3 * sizeof(v2),
+  };
+  v3* vertex = (v3*)((u8*)mesh + mesh->vertex);
+  vertex[0] = V3(0, 0, 0);
+  vertex[1] = V3(1, 0, 0);
+  vertex[2] = V3(0, 1, 0);
+  ((v3*)((u8*)mesh + mesh->normal))[0] = V3(0, 0, 1);
+  v2* uv = (v2*)((u8*)mesh + mesh->uv);
+  uv[0] = V2(0, 0);
+  uv[1] = V2(1, 0);
+  uv[2] = V2(0, 1);
+  u32* vertex_index = (u32*)((u8*)mesh + mesh->vertex_index);
+  u32* normal_index = (u32*)((u8*)mesh + mesh->normal_index);
+  u32* uv_index = (u32*)((u8*)mesh + mesh->uv_index);
+  for (u32 i = 0; i < 3; ++i) {
+    vertex_index[i] = i;
+    normal_index[i] = 0;
+    uv_index[i] = i;
+  }
+
+  Pack_texture* texture = (Pack_texture*)(data + TEXTURE_OFFSET);
+  *texture = (Pack_texture) { .type = PACK_ENTRY_TEXTURE, .level_count = 1, };
+  texture->levels[0] = (Pack_texture_level) {
+    .width = 2,
+    .height = 2,
+    .format = TEXTURE_FORMAT_RGBA8,
+    .flags = TEXTURE_POW2,
+    .width_shift = 1,
+    .width_mask = 1,
+    .height_mask = 1,
+    .data = sizeof(Pack_texture) + sizeof(Pack_texture_level),
+    .size = 4 * sizeof(Color),
+  };
+  Color* texels = (Color*)((u8*)texture + texture->levels[0].data);
+  texels[0] = texels[3] = COLOR_RGB(255, 255, 255);
+  texels[1] = texels[2] = COLOR_RGB(0, 0, 0);
+
+  Pack_texture* indexed = (Pack_texture*)(data + PALETTE_OFFSET);
+  *indexed = (Pack_texture) { .type = PACK_ENTRY_TEXTURE, .level_count = 1, .palette = sizeof(Pack_texture) + sizeof(Pack_texture_level), };
+  indexed->levels[0] = (Pack_texture_level) {
+    .width = 2,
+    .height = 2,
+    .format = TEXTURE_FORMAT_PALETTE8,
+    .data = indexed->palette + 256 * sizeof(Color),
+    .size = 4,
+  };
+  Color* palette = (Color*)((u8*)indexed + indexed->palette);
+  for (u32 i = 0; i < 256; ++i) {
+    palette[i] = COLOR_RGB(i, i, i);
+  }
+  u8* indices = (u8*)indexed + indexed->levels[0].data;
+  for (u32 i = 0; i < 4; ++i) {
+    indices[i] = i * 85;
+  }
+}
+
+// change a field of a level of the texture, and check that the texture is then valid or not
+#define CHECK_LEVEL(entry, level, field, value, expected) do { \
+  pack_build(pack_data); \
+  Pack_texture* _t = (Pack_texture*)(pack_data + (entry)->offset); \
+  _t->levels[level].field = (value); \
+  Pack _pack = {0}; \
+  Texture _texture = {0}; \
+  Texture _mips[PACK_MAX_MIPS] = {0}; \
+  CHECK(pack_from_memory(&_pack, pack_data, PACK_SIZE) == Ok); \
+  CHECK(pack_get_texture(&_pack, (entry), &_texture, _mips) == (expected)); \
+} while (0)
+
+static void test_valid(void) {
+  Pack pack = {0};
+  Mesh mesh = {0};
+  Texture texture = {0};
+  Texture mips[PACK_MAX_MIPS] = {0};
+  pack_build(pack_data);
+  CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE) == Ok);
+  CHECK(pack_find(&pack, "missing") == NULL);
+  const Pack_entry* mesh_entry = pack_find(&pack, "triangle");
+  const Pack_entry* texture_entry = pack_find(&pack, "checker");
+  CHECK(mesh_entry && texture_entry);
+  if (!mesh_entry || !texture_entry) {
+    return;
+  }
+  CHECK(pack_get_mesh(&pack, mesh_entry, &mesh) == Ok);
+  CHECK(mesh.vertex_count == 3 && mesh.vertex_index_count == 3);
+  CHECK(mesh.vertex[1].x == 1 && mesh.vertex[2].y == 1 && mesh.vertex_index[2] == 2);
+  CHECK(mesh.normal[mesh.normal_index[1]].z == 1 && mesh.uv[mesh.uv_index[2]].v == 1);
+  CHECK(mesh.light == NULL);
+  CHECK(pack_get_texture(&pack, texture_entry, &texture, mips) == Ok);
+  CHECK(texture.width == 2 && texture.height == 2 && texture.mip_count == 0 && texture.mips == NULL);
+  CHECK(texture.data[0].value == COLOR_RGB(255, 255, 255).value && texture.data[1].value == COLOR_RGB(0, 0, 0).value);
+  const Pack_entry* indexed_entry = pack_find(&pack, "indexed");
+  CHECK(indexed_entry && pack_get_texture(&pack, indexed_entry, &texture, mips) == Ok);
+  CHECK(texture.format == TEXTURE_FORMAT_PALETTE8 && texture.palette && texture.indices[3] == 255 && texture.palette[255].r == 255);
+  // an entry of the other type is refused
+  CHECK(pack_get_texture(&pack, mesh_entry, &texture, mips) == Error);
+  CHECK(pack_get_mesh(&pack, texture_entry, &mesh) == Error);
+}
+
+static void test_truncated_header(void) {
+  Pack pack = {0};
+  pack_build(pack_data);
+  CHECK(pack_from_memory(&pack, pack_data, sizeof(Pack_header) - 1) == Error);
+  // the header claims more than there is
+  CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE - 1) == Error);
+  // the entries run past the end of the pack
+  ((Pack_header*)pack_data)->entry_count = PACK_SIZE / sizeof(Pack_entry) + 1;
+  CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE) == Error);
+  // an entry count that wraps around when it is multiplied by the size of an entry with a 32 bit size_t
+  ((Pack_header*)pack_data)->entry_count = UINT32_MAX / sizeof(Pack_entry) + 1;
+  CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE) == Error);
+  pack_build(pack_data);
+  ((Pack_header*)pack_data)->magic = 0;
+  CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE) == Error);
+  pack_build(pack_data);
+  ((Pack_header*)pack_data)->version = PACK_VERSION + 1;
+  CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE) == Error);
+}
+
+static void test_out_of_range(void) {
+  Pack pack = {0};
+  Mesh mesh = {0};
+  Texture texture = {0};
+  Texture mips[PACK_MAX_MIPS] = {0};
+  Pack_entry* entries = (Pack_entry*)(pack_data + sizeof(Pack_header));
+  Pack_mesh* m = (Pack_mesh*)(pack_data + MESH_OFFSET);
+  Pack_texture* t = (Pack_texture*)(pack_data + TEXTURE_OFFSET);
+
+  // section past the end of the pack
+  pack_build(pack_data);
+  entries[0].offset = PACK_SIZE + PACK_ALIGNMENT;
+  CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE) == Ok);
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+  // section size that wraps around
+  pack_build(pack_data);
+  entries[1].size = UINT32_MAX;
+  CHECK(pack_get_texture(&pack, &entries[1], &texture, mips) == Error);
+  // arrays outside of their section
+  pack_build(pack_data);
+  m->vertex = MESH_SIZE;
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+  pack_build(pack_data);
+  m->vertex_index_count = UINT32_MAX / sizeof(u32);
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+  // a count that wraps around to a small size when multiplied by the size of a vertex in 32 bits
+  pack_build(pack_data);
+  m->vertex_count = UINT32_MAX / sizeof(v3) + 1;
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+  pack_build(pack_data);
+  m->light_count = 1;
+  m->light = m->vertex;
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+  // indices past the end of the arrays that they index
+  for (i32 array = 0; array < 3; ++array) {
+    pack_build(pack_data);
+    const u32 offset = array == 0 ? m->vertex_index : array == 1 ? m->normal_index : m->uv_index;
+    const u32 count = array == 0 ? m->vertex_count : array == 1 ? m->normal_count : m->uv_count;
+    ((u32*)((u8*)m + offset))[1] = count;
+    CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+  }
+  // an index array that is neither empty nor as long as the vertex indices
+  pack_build(pack_data);
+  m->normal_index_count = 2;
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+  pack_build(pack_data);
+  m->uv_index_count = 0;
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Ok);
+  m->uv_index_count = 1;
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+  // part of a triangle
+  pack_build(pack_data);
+  m->vertex_index_count = 2;
+  m->normal_index_count = 0;
+  m->uv_index_count = 0;
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+  pack_build(pack_data);
+  t->levels[0].size = TEXTURE_SIZE;
+  CHECK(pack_get_texture(&pack, &entries[1], &texture, mips) == Error);
+  pack_build(pack_data);
+  t->level_count = PACK_MAX_MIPS + 2;
+  CHECK(pack_get_texture(&pack, &entries[1], &texture, mips) == Error);
+}
+
+// levels whose fields would make the samplers read outside of their data
+static void test_texture_levels(void) {
+  const Pack_entry* entries = (const Pack_entry*)(pack_data + sizeof(Pack_header));
+  const Pack_entry* rgba = &entries[1];
+  const Pack_entry* indexed = &entries[2];
+
+  // dimensions, format and flags
+  CHECK_LEVEL(rgba, 0, width, 0, Error);
+  CHECK_LEVEL(rgba, 0, height, 0, Error);
+  CHECK_LEVEL(rgba, 0, format, TEXTURE_FORMAT_BC1 + 1, Error);
+  CHECK_LEVEL(rgba, 0, flags, TEXTURE_POW2 | (1 << 2), Error);
+  // data smaller than the dimensions, for each format
+  CHECK_LEVEL(rgba, 0, size, 4 * sizeof(Color) - 1, Error);
+  CHECK_LEVEL(indexed, 0, size, 3, Error);
+  CHECK_LEVEL(rgba, 0, format, TEXTURE_FORMAT_BC1, Error);
+  // a bc1 level is 8 bytes per 4x4 block and is made of whole blocks
+  {
+    pack_build(pack_data);
+    Pack_texture_level* level = &((Pack_texture*)(pack_data + rgba->offset))->levels[0];
+    Pack pack = {0};
+    Texture texture = {0};
+    Texture mips[PACK_MAX_MIPS] = {0};
+    CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE) == Ok);
+    *level = (Pack_texture_level) { .width = 8, .height = 4, .format = TEXTURE_FORMAT_BC1, .data = level->data, .size = 16, };
+    CHECK(pack_get_texture(&pack, rgba, &texture, mips) == Ok);
+    level->height = 8;
+    CHECK(pack_get_texture(&pack, rgba, &texture, mips) == Error);
+    level->width = 6;
+    level->height = 4;
+    CHECK(pack_get_texture(&pack, rgba, &texture, mips) == Error);
+  }
+  // indices without a palette
+  {
+    pack_build(pack_data);
+    ((Pack_texture*)(pack_data + indexed->offset))->palette = 0;
+    Pack pack = {0};
+    Texture texture = {0};
+    Texture mips[PACK_MAX_MIPS] = {0};
+    CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE) == Ok);
+    CHECK(pack_get_texture(&pack, indexed, &texture, mips) == Error);
+  }
+  // power of two addressing that doesn't match the dimensions
+  CHECK_LEVEL(rgba, 0, width_shift, 2, Error);
+  CHECK_LEVEL(rgba, 0, width_shift, 33, Error);
+  CHECK_LEVEL(rgba, 0, width_mask, 3, Error);
+  CHECK_LEVEL(rgba, 0, height_mask, 0, Error);
+  CHECK_LEVEL(rgba, 0, height, 1, Error);
+  CHECK_LEVEL(indexed, 0, flags, TEXTURE_POW2, Error);
+  // blocks that don't divide the dimensions
+  CHECK_LEVEL(rgba, 0, flags, TEXTURE_POW2 | TEXTURE_SWIZZLED, Ok);
+  {
+    pack_build(pack_data);
+    Pack_texture_level* level = &((Pack_texture*)(pack_data + rgba->offset))->levels[0];
+    Pack pack = {0};
+    Texture texture = {0};
+    Texture mips[PACK_MAX_MIPS] = {0};
+    CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE) == Ok);
+    level->flags = TEXTURE_POW2 | TEXTURE_SWIZZLED;
+    level->block_shift = 1;
+    CHECK(pack_get_texture(&pack, rgba, &texture, mips) == Ok);
+    level->block_shift = 2;
+    CHECK(pack_get_texture(&pack, rgba, &texture, mips) == Error);
+    level->block_shift = 40;
+    CHECK(pack_get_texture(&pack, rgba, &texture, mips) == Error);
+  }
+}
+
+static void test_misaligned(void) {
+  Pack pack = {0};
+  Mesh mesh = {0};
+  Pack_entry* entries = (Pack_entry*)(pack_data + sizeof(Pack_header));
+  Pack_mesh* m = (Pack_mesh*)(pack_data + MESH_OFFSET);
+
+  // the pack itself, built aligned and moved so that its arrays are written as the type they hold
+  pack_build(pack_data);
+  memmove(pack_data + 4, pack_data, PACK_SIZE);
+  CHECK(pack_from_memory(&pack, pack_data + 4, PACK_SIZE) == Error);
+  // an array within a section
+  pack_build(pack_data);
+  CHECK(pack_from_memory(&pack, pack_data, PACK_SIZE) == Ok);
+  m->vertex_index += 2;
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+  // a section
+  pack_build(pack_data);
+  entries[0].offset += 2;
+  CHECK(pack_get_mesh(&pack, &entries[0], &mesh) == Error);
+}
+
+i32 main(void) {
+  test_valid();
+  test_truncated_header();
+  test_out_of_range();
+  test_texture_levels();
+  test_misaligned();
+  if (failures) {
+    printf("%d checks failed\n", failures);
+    return EXIT_FAILURE;
+  }
+  printf("ok\n");
+  return EXIT_SUCCESS;
+}
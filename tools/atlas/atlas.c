@@ -0,0 +1,325 @@
+// atlas.c
+// pack png images into a single texture atlas, and write the placement of each image to a layout file for objtoc
+
+#include <assert.h>
+
+#define COMMON_IMPLEMENTATION
+#include "common.h"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+#define MAX_IMAGES 256
+#define MAX_NAME_SIZE 128
+#define DEFAULT_PADDING 4
+#define MAX_ATLAS_SIZE 8192
+
+typedef struct Image {
+  char name[MAX_NAME_SIZE];
+  u32* data;
+  i32 width;
+  i32 height;
+  i32 x; // placement of the image within the atlas, excluding padding
+  i32 y;
+} Image;
+
+typedef struct Atlas {
+  u32* data;
+  i32 width;
+  i32 height;
+} Atlas;
+
+const char* next(i32* argc, char*** argv);
+Result image_load(const char* path, Image* image);
+Result pack(Image** images, i32 count, i32 padding, Atlas* atlas);
+void blit_padded(Atlas* atlas, const Image* image, i32 padding);
+Result png_write(const char* path, const Atlas* atlas);
+Result layout_write(const char* path, Image* images, i32 count, const Atlas* atlas);
+i32 align(i32 n, i32 alignment);
+i32 next_pow2(i32 n);
+
+static Image images[MAX_IMAGES] = {0};
+
+i32 main(i32 argc, char** argv) {
+  i32 result = EXIT_SUCCESS;
+  const char* output_path = NULL;
+  const char* layout_path = NULL;
+  i32 padding = DEFAULT_PADDING;
+  i32 count = 0;
+  Image* sorted[MAX_IMAGES] = {0};
+  Atlas atlas = {0};
+
+  if (argc < 4) {
+    printf("Usage; %s <atlas.png> <layout.txt> [options] <images...>\n", argv[0]);
+    printf("  -p <padding>    texels of wrapped border around each image, default %d\n", DEFAULT_PADDING);
+    return_defer(EXIT_FAILURE);
+  }
+  next(&argc, &argv);
+  output_path = next(&argc, &argv);
+  layout_path = next(&argc, &argv);
+  while (argc > 0) {
+    const char* arg = next(&argc, &argv);
+    if (!strcmp(arg, "-p") && argc > 0) {
+      padding = atoi(next(&argc, &argv));
+      if (padding < 0) {
+        fprintf(stderr, "error: padding must not be negative\n");
+        return_defer(EXIT_FAILURE);
+      }
+      continue;
+    }
+    if (count >= MAX_IMAGES) {
+      fprintf(stderr, "error: too many images, max is %d\n", MAX_IMAGES);
+      return_defer(EXIT_FAILURE);
+    }
+    if (image_load(arg, &images[count]) != Ok) {
+      return_defer(EXIT_FAILURE);
+    }
+    sorted[count] = &images[count];
+    count += 1;
+  }
+  if (count == 0) {
+    fprintf(stderr, "error: no images to pack\n");
+    return_defer(EXIT_FAILURE);
+  }
+
+  if (pack(sorted, count, padding, &atlas) != Ok) {
+    return_defer(EXIT_FAILURE);
+  }
+  for (i32 i = 0; i < count; ++i) {
+    blit_padded(&atlas, &images[i], padding);
+  }
+  if (png_write(output_path, &atlas) != Ok) {
+    return_defer(EXIT_FAILURE);
+  }
+  if (layout_write(layout_path, images, count, &atlas) != Ok) {
+    return_defer(EXIT_FAILURE);
+  }
+  fprintf(stdout, "packed %d images into %dx%d atlas `%s`\n", count, atlas.width, atlas.height, output_path);
+defer:
+  for (i32 i = 0; i < count; ++i) {
+    stbi_image_free(images[i].data);
+  }
+  free(atlas.data);
+  return result;
+}
+
+const char* next(i32* argc, char*** argv) {
+  assert(*argc > 0);
+  const char* result = *argv[0];
+  *argc -= 1;
+  *argv += 1;
+  return result;
+}
+
+// the image is named after its file name without directory and extension
+Result image_load(const char* path, Image* image) {
+  image->data = (u32*)stbi_load(path, &image->width, &image->height, NULL, 4);
+  if (!image->data) {
+    fprintf(stderr, "error: failed to load image `%s`\n", path);
+    return Error;
+  }
+  const char* base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  snprintf(image->name, sizeof(image->name), "%s", base);
+  char* extension = strrchr(image->name, '.');
+  if (extension) {
+    *extension = 0;
+  }
+  return Ok;
+}
+
+static i32 compare_height(const void* a, const void* b) {
+  const Image* ia = *(const Image**)a;
+  const Image* ib = *(const Image**)b;
+  if (ia->height != ib->height) {
+    return ib->height - ia->height;
+  }
+  return ib->width - ia->width;
+}
+
+// shelf packing of the padded images sorted by height, trying power of two widths until the atlas is no taller than it is wide.
+// cells are aligned to the padding so that the first log2(padding) mip levels never blend texels of neighbouring images
+Result pack(Image** images, i32 count, i32 padding, Atlas* atlas) {
+  const i32 cell_alignment = MAX(padding, 1);
+  qsort(images, count, sizeof(Image*), compare_height);
+  i32 widest = 0;
+  for (i32 i = 0; i < count; ++i) {
+    widest = MAX(widest, align(images[i]->width + padding * 2, cell_alignment));
+  }
+  for (i32 width = next_pow2(widest); width <= MAX_ATLAS_SIZE; width *= 2) {
+    i32 x = 0;
+    i32 y = 0;
+    i32 shelf_height = 0;
+    for (i32 i = 0; i < count; ++i) {
+      Image* image = images[i];
+      const i32 cell_width = align(image->width + padding * 2, cell_alignment);
+      const i32 cell_height = align(image->height + padding * 2, cell_alignment);
+      if (x + cell_width > width) {
+        x = 0;
+        y += shelf_height;
+        shelf_height = 0;
+      }
+      image->x = x + padding;
+      image->y = y + padding;
+      x += cell_width;
+      shelf_height = MAX(shelf_height, cell_height);
+    }
+    const i32 height = next_pow2(y + shelf_height);
+    if (height <= width) {
+      atlas->width = width;
+      atlas->height = height;
+      atlas->data = calloc(width * height, sizeof(u32));
+      if (!atlas->data) {
+        fprintf(stderr, "error: failed to allocate atlas\n");
+        return Error;
+      }
+      return Ok;
+    }
+  }
+  fprintf(stderr, "error: images don't fit in a %dx%d atlas\n", MAX_ATLAS_SIZE, MAX_ATLAS_SIZE);
+  return Error;
+}
+
+// copy the image with a border of wrapped texels, so that filtering across the edges samples the same texels as the unpacked texture would
+void blit_padded(Atlas* atlas, const Image* image, i32 padding) {
+  for (i32 y = -padding; y < image->height + padding; ++y) {
+    const i32 src_y = ((y % image->height) + image->height) % image->height;
+    for (i32 x = -padding; x < image->width + padding; ++x) {
+      const i32 src_x = ((x % image->width) + image->width) % image->width;
+      atlas->data[(image->y + y) * atlas->width + (image->x + x)] = image->data[src_y * image->width + src_x];
+    }
+  }
+}
+
+static u32 crc_table[256] = {0};
+
+static void crc_init(void) {
+  for (u32 i = 0; i < 256; ++i) {
+    u32 c = i;
+    for (u32 k = 0; k < 8; ++k) {
+      c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+    }
+    crc_table[i] = c;
+  }
+}
+
+static u32 crc_update(u32 crc, const u8* data, size_t size) {
+  for (size_t i = 0; i < size; ++i) {
+    crc = crc_table[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return crc;
+}
+
+static void write_u32_be(FILE* fp, u32 value) {
+  const u8 bytes[4] = { value >> 24, value >> 16, value >> 8, value };
+  fwrite(bytes, 1, sizeof(bytes), fp);
+}
+
+static void png_chunk(FILE* fp, const char* type, const u8* data, u32 size) {
+  write_u32_be(fp, size);
+  fwrite(type, 1, 4, fp);
+  fwrite(data, 1, size, fp);
+  u32 crc = crc_update(0xffffffff, (const u8*)type, 4);
+  crc = crc_update(crc, data, size);
+  write_u32_be(fp, crc ^ 0xffffffff);
+}
+
+// 8 bit rgba png with the image data in uncompressed (stored) deflate blocks, which keeps the writer dependency free.
+// the atlas is only an intermediate input to pngtoc, so its size on disk doesn't matter
+Result png_write(const char* path, const Atlas* atlas) {
+  Result result = Ok;
+  const size_t row_size = 1 + atlas->width * sizeof(u32);
+  const size_t raw_size = row_size * atlas->height;
+  const size_t block_count = (raw_size + 0xffff - 1) / 0xffff;
+  const size_t zlib_size = 2 + raw_size + block_count * 5 + 4;
+  u8* raw = malloc(raw_size);
+  u8* zlib = malloc(zlib_size);
+  FILE* fp = NULL;
+  if (!raw || !zlib) {
+    fprintf(stderr, "error: failed to allocate png buffers\n");
+    return_defer(Error);
+  }
+  for (i32 y = 0; y < atlas->height; ++y) {
+    u8* row = &raw[y * row_size];
+    row[0] = 0; // no filter
+    memcpy(&row[1], &atlas->data[y * atlas->width], atlas->width * sizeof(u32));
+  }
+
+  u8* dest = zlib;
+  *dest++ = 0x78;
+  *dest++ = 0x01;
+  for (size_t offset = 0; offset < raw_size; offset += 0xffff) {
+    const u16 size = MIN(raw_size - offset, 0xffff);
+    *dest++ = (offset + size == raw_size);
+    *dest++ = size & 0xff;
+    *dest++ = size >> 8;
+    *dest++ = ~size & 0xff;
+    *dest++ = (u16)~size >> 8;
+    memcpy(dest, &raw[offset], size);
+    dest += size;
+  }
+  u32 a = 1;
+  u32 b = 0;
+  for (size_t i = 0; i < raw_size; ++i) {
+    a = (a + raw[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  const u32 adler = (b << 16) | a;
+  *dest++ = adler >> 24;
+  *dest++ = adler >> 16;
+  *dest++ = adler >> 8;
+  *dest++ = adler;
+
+  fp = fopen(path, "wb");
+  if (!fp) {
+    fprintf(stderr, "error: failed to open `%s` for writing\n", path);
+    return_defer(Error);
+  }
+  crc_init();
+  const u8 signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+  fwrite(signature, 1, sizeof(signature), fp);
+  const u8 header[13] = {
+    atlas->width >> 24, atlas->width >> 16, atlas->width >> 8, atlas->width,
+    atlas->height >> 24, atlas->height >> 16, atlas->height >> 8, atlas->height,
+    8, // bit depth
+    6, // rgba
+    0, 0, 0,
+  };
+  png_chunk(fp, "IHDR", header, sizeof(header));
+  png_chunk(fp, "IDAT", zlib, dest - zlib);
+  png_chunk(fp, "IEND", NULL, 0);
+defer:
+  if (fp) {
+    fclose(fp);
+  }
+  free(raw);
+  free(zlib);
+  return result;
+}
+
+// one line per image: <name> <x> <y> <width> <height> <atlas width> <atlas height>
+Result layout_write(const char* path, Image* images, i32 count, const Atlas* atlas) {
+  FILE* fp = fopen(path, "w");
+  if (!fp) {
+    fprintf(stderr, "error: failed to open `%s` for writing\n", path);
+    return Error;
+  }
+  for (i32 i = 0; i < count; ++i) {
+    const Image* image = &images[i];
+    fprintf(fp, "%s %d %d %d %d %d %d\n", image->name, image->x, image->y, image->width, image->height, atlas->width, atlas->height);
+  }
+  fclose(fp);
+  return Ok;
+}
+
+i32 align(i32 n, i32 alignment) {
+  return ((n + alignment - 1) / alignment) * alignment;
+}
+
+i32 next_pow2(i32 n) {
+  i32 result = 1;
+  while (result < n) {
+    result *= 2;
+  }
+  return result;
+}
@@ -0,0 +1,325 @@
+// lightbake.c
+// bake the lighting of static meshes into their pack sections (written by objtoc with -b), as one light intensity per
+// vertex index. direct light is shadowed by all of the given meshes, and a single diffuse bounce is gathered from them.
+// the meshes are baked as they are in the section, so they have to be drawn without a transform
+
+#include <assert.h>
+
+#define COMMON_IMPLEMENTATION
+#include "common.h"
+#include "maths.h"
+#include "texture.h"
+#include "config.h"
+#include "mesh.h"
+#include "pack.h"
+#include "light.h"
+
+#include "maths.c"
+#include "light.c"
+#include "pack.c"
+
+#define MAX_LIGHTS 64
+#define MAX_SECTIONS 64
+#define DEFAULT_SAMPLES 64
+#define DEFAULT_ALBEDO 0.5f
+#define RAY_OFFSET 0.001f
+
+#define ALIGN(N, ALIGNMENT) ((((N) + (ALIGNMENT) - 1) / (ALIGNMENT)) * (ALIGNMENT))
+
+typedef struct Section {
+  const char* path;
+  u8* data;
+  u32 size;
+  Mesh mesh;
+  f32* direct; // per vertex index
+  f32* light;
+} Section;
+
+typedef struct Bake_triangle {
+  v3 p[3];
+  v3 normal;
+  const f32* direct;
+} Bake_triangle;
+
+Result section_read(Section* section);
+Result section_write(const Section* section);
+void triangles_build(void);
+void bake_direct(Section* section);
+void bake_bounce(Section* section);
+bool ray_cast(v3 origin, v3 dir, f32 max_distance, const Bake_triangle** hit, f32* u, f32* v);
+v3 triangle_normal(v3 a, v3 b, v3 c);
+v3 random_hemisphere(v3 normal);
+
+static Light lights[MAX_LIGHTS] = {0};
+static u32 light_count = 0;
+static Section sections[MAX_SECTIONS] = {0};
+static u32 section_count = 0;
+static Bake_triangle* triangles = NULL;
+static u32 triangle_count = 0;
+static u32 samples = DEFAULT_SAMPLES;
+static f32 albedo = DEFAULT_ALBEDO;
+static u32 random_state = 0x9e3779b9;
+
+i32 main(i32 argc, char** argv) {
+  i32 result = EXIT_SUCCESS;
+  if (argc < 2) {
+    printf("Usage; %s [options] <sections...>\n", argv[0]);
+    printf("  -l <x> <y> <z> <strength> <radius>    add a point light\n");
+    printf("  -s <samples>                          bounce rays per vertex, default %d\n", DEFAULT_SAMPLES);
+    printf("  -a <albedo>                           reflectance of the bouncing surfaces, default %g\n", DEFAULT_ALBEDO);
+    printf("  the sections are baked in place\n");
+    return_defer(EXIT_FAILURE);
+  }
+  for (i32 i = 1; i < argc; ++i) {
+    if (!strcmp(argv[i], "-l") && i + 5 < argc) {
+      if (light_count >= MAX_LIGHTS) {
+        fprintf(stderr, "error: too many lights, max is %d\n", MAX_LIGHTS);
+        return_defer(EXIT_FAILURE);
+      }
+      v3 pos = V3(atof(argv[i + 1]), atof(argv[i + 2]), atof(argv[i + 3]));
+      lights[light_count++] = light_create(pos, atof(argv[i + 4]), atof(argv[i + 5]));
+      i += 5;
+    }
+    else if (!strcmp(argv[i], "-s") && i + 1 < argc) {
+      samples = atoi(argv[++i]);
+    }
+    else if (!strcmp(argv[i], "-a") && i + 1 < argc) {
+      albedo = atof(argv[++i]);
+    }
+    else {
+      if (section_count >= MAX_SECTIONS) {
+        fprintf(stderr, "error: too many sections, max is %d\n", MAX_SECTIONS);
+        return_defer(EXIT_FAILURE);
+      }
+      sections[section_count].path = argv[i];
+      if (section_read(&sections[section_count]) != Ok) {
+        return_defer(EXIT_FAILURE);
+      }
+      section_count += 1;
+    }
+  }
+  if (section_count == 0) {
+    fprintf(stderr, "error: no sections to bake\n");
+    return_defer(EXIT_FAILURE);
+  }
+
+  // every pass needs the direct light of the whole scene, so that bounces can be gathered from any mesh
+  for (u32 i = 0; i < section_count; ++i) {
+    bake_direct(&sections[i]);
+  }
+  triangles_build();
+  for (u32 i = 0; i < section_count; ++i) {
+    bake_bounce(&sections[i]);
+    if (section_write(&sections[i]) != Ok) {
+      return_defer(EXIT_FAILURE);
+    }
+  }
+  fprintf(stdout, "baked %d lights into %d meshes (%d triangles)\n", light_count, section_count, triangle_count);
+defer:
+  for (u32 i = 0; i < section_count; ++i) {
+    free(sections[i].data);
+    free(sections[i].direct);
+    free(sections[i].light);
+  }
+  free(triangles);
+  return result;
+}
+
+Result section_read(Section* section) {
+  Result result = Ok;
+  FILE* fp = fopen(section->path, "rb");
+  if (!fp) {
+    fprintf(stderr, "error: failed to open section `%s`\n", section->path);
+    return_defer(Error);
+  }
+  fseek(fp, 0, SEEK_END);
+  section->size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  // aligned like the pack, so that the arrays can be used where they are
+  section->data = aligned_alloc(PACK_ALIGNMENT, ALIGN(section->size, PACK_ALIGNMENT));
+  if (!section->data || fread(section->data, 1, section->size, fp) != section->size) {
+    fprintf(stderr, "error: failed to read section `%s`\n", section->path);
+    return_defer(Error);
+  }
+  const Pack pack = { .data = section->data, .size = section->size, .mapped = false, };
+  const Pack_entry entry = { .type = PACK_ENTRY_MESH, .offset = 0, .size = section->size, };
+  if (section->size < sizeof(Pack_mesh) || pack_get_mesh(&pack, &entry, &section->mesh) != Ok) {
+    fprintf(stderr, "error: `%s` is not a mesh section\n", section->path);
+    return_defer(Error);
+  }
+  section->direct = calloc(section->mesh.vertex_index_count, sizeof(f32));
+  section->light = calloc(section->mesh.vertex_index_count, sizeof(f32));
+  if (!section->direct || !section->light) {
+    fprintf(stderr, "error: failed to allocate light of `%s`\n", section->path);
+    return_defer(Error);
+  }
+defer:
+  if (fp) {
+    fclose(fp);
+  }
+  return result;
+}
+
+// the section as it was, without any previously baked light, followed by the new light stream
+Result section_write(const Section* section) {
+  Pack_mesh header = *(const Pack_mesh*)section->data;
+  const u32 size = header.light_count ? header.light : section->size;
+  static const u8 zero[PACK_ALIGNMENT] = {0};
+  FILE* fp = fopen(section->path, "wb");
+  if (!fp) {
+    fprintf(stderr, "error: failed to open `%s` for writing\n", section->path);
+    return Error;
+  }
+  header.light_count = section->mesh.vertex_index_count;
+  header.light = ALIGN(size, PACK_ALIGNMENT);
+  fwrite(&header, 1, sizeof(header), fp);
+  fwrite(section->data + sizeof(header), 1, size - sizeof(header), fp);
+  fwrite(zero, 1, header.light - size, fp);
+  fwrite(section->light, sizeof(f32), header.light_count, fp);
+  fwrite(zero, 1, ALIGN(header.light_count * sizeof(f32), PACK_ALIGNMENT) - header.light_count * sizeof(f32), fp);
+  fclose(fp);
+  return Ok;
+}
+
+void triangles_build(void) {
+  for (u32 i = 0; i < section_count; ++i) {
+    triangle_count += sections[i].mesh.vertex_index_count / 3;
+  }
+  triangles = calloc(triangle_count, sizeof(Bake_triangle));
+  assert(triangles);
+  Bake_triangle* t = triangles;
+  for (u32 i = 0; i < section_count; ++i) {
+    const Mesh* mesh = &sections[i].mesh;
+    for (u32 index = 0; index + 2 < mesh->vertex_index_count; index += 3, ++t) {
+      for (u32 k = 0; k < 3; ++k) {
+        t->p[k] = mesh->vertex[mesh->vertex_index[index + k]];
+      }
+      t->normal = triangle_normal(t->p[0], t->p[1], t->p[2]);
+      t->direct = &sections[i].direct[index];
+    }
+  }
+}
+
+// the same face normal and light model as the renderer, with a shadow ray per light
+void bake_direct(Section* section) {
+  const Mesh* mesh = &section->mesh;
+  for (u32 index = 0; index + 2 < mesh->vertex_index_count; index += 3) {
+    const v3 p[3] = {
+      mesh->vertex[mesh->vertex_index[index + 0]],
+      mesh->vertex[mesh->vertex_index[index + 1]],
+      mesh->vertex[mesh->vertex_index[index + 2]],
+    };
+    const v3 normal = triangle_normal(p[0], p[1], p[2]);
+    for (u32 k = 0; k < 3; ++k) {
+      const v3 origin = V3_OP(p[k], V3_OP1(normal, RAY_OFFSET, *), +);
+      f32 direct = 0;
+      for (u32 i = 0; i < light_count; ++i) {
+        const f32 intensity = light_calculate_intensity(lights[i], p[k], normal);
+        if (intensity <= 0) {
+          continue;
+        }
+        v3 to_light = V3_OP(lights[i].pos, origin, -);
+        const f32 distance = v3_length(to_light);
+        to_light = v3_div_scalar(to_light, distance);
+        if (!ray_cast(origin, to_light, distance, NULL, NULL, NULL)) {
+          direct += intensity;
+        }
+      }
+      section->direct[index + k] = direct;
+    }
+  }
+}
+
+// light reflected towards each vertex by the directly lit surfaces around it, from cosine weighted rays
+void bake_bounce(Section* section) {
+  const Mesh* mesh = &section->mesh;
+  for (u32 index = 0; index + 2 < mesh->vertex_index_count; index += 3) {
+    const v3 p[3] = {
+      mesh->vertex[mesh->vertex_index[index + 0]],
+      mesh->vertex[mesh->vertex_index[index + 1]],
+      mesh->vertex[mesh->vertex_index[index + 2]],
+    };
+    const v3 normal = triangle_normal(p[0], p[1], p[2]);
+    for (u32 k = 0; k < 3; ++k) {
+      const v3 origin = V3_OP(p[k], V3_OP1(normal, RAY_OFFSET, *), +);
+      f32 bounce = 0;
+      for (u32 s = 0; s < samples; ++s) {
+        const v3 dir = random_hemisphere(normal);
+        const Bake_triangle* hit = NULL;
+        f32 u = 0;
+        f32 v = 0;
+        if (ray_cast(origin, dir, INFINITY, &hit, &u, &v) && v3_dot(dir, hit->normal) < 0) {
+          bounce += hit->direct[0] * (1 - u - v) + hit->direct[1] * u + hit->direct[2] * v;
+        }
+      }
+      section->light[index + k] = section->direct[index + k] + (samples > 0 ? albedo * bounce / samples : 0);
+    }
+  }
+}
+
+// nearest intersection closer than max_distance (moller-trumbore). without `hit`, any intersection will do
+bool ray_cast(v3 origin, v3 dir, f32 max_distance, const Bake_triangle** hit, f32* u, f32* v) {
+  f32 nearest = max_distance;
+  bool result = false;
+  for (u32 i = 0; i < triangle_count; ++i) {
+    const Bake_triangle* t = &triangles[i];
+    const v3 e1 = v3_sub(t->p[1], t->p[0]);
+    const v3 e2 = v3_sub(t->p[2], t->p[0]);
+    const v3 pv = v3_cross(dir, e2);
+    const f32 det = v3_dot(e1, pv);
+    if (ABS(f32, det) < EPS) {
+      continue;
+    }
+    const f32 inv_det = 1.0f / det;
+    const v3 tv = v3_sub(origin, t->p[0]);
+    const f32 tu = v3_dot(tv, pv) * inv_det;
+    if (tu < 0 || tu > 1) {
+      continue;
+    }
+    const v3 qv = v3_cross(tv, e1);
+    const f32 tw = v3_dot(dir, qv) * inv_det;
+    if (tw < 0 || tu + tw > 1) {
+      continue;
+    }
+    const f32 distance = v3_dot(e2, qv) * inv_det;
+    if (distance <= 0 || distance >= nearest) {
+      continue;
+    }
+    if (!hit) {
+      return true;
+    }
+    nearest = distance;
+    *hit = t;
+    *u = tu;
+    *v = tw;
+    result = true;
+  }
+  return result;
+}
+
+inline v3 triangle_normal(v3 a, v3 b, v3 c) {
+  return v3_normalize(v3_cross(v3_sub(b, a), v3_sub(c, a)));
+}
+
+static f32 random_f32(void) {
+  random_state ^= random_state << 13;
+  random_state ^= random_state >> 17;
+  random_state ^= random_state << 5;
+  return (random_state >> 8) / (f32)(1 << 24);
+}
+
+// cosine weighted direction around the normal
+v3 random_hemisphere(v3 normal) {
+  const f32 r = square_root(random_f32());
+  const f32 phi = 2 * PI32 * random_f32();
+  const f32 x = r * cosf(phi);
+  const f32 y = r * sinf(phi);
+  const f32 z = square_root(MAX(1 - x * x - y * y, 0));
+  const v3 tangent = v3_normalize(v3_cross(ABS(f32, normal.x) > 0.9f ? V3(0, 1, 0) : V3(1, 0, 0), normal));
+  const v3 bitangent = v3_cross(normal, tangent);
+  return V3(
+    tangent.x * x + bitangent.x * y + normal.x * z,
+    tangent.y * x + bitangent.y * y + normal.y * z,
+    tangent.z * x + bitangent.z * y + normal.z * z
+  );
+}
@@ -4,7 +4,9 @@
 #define COMMON_IMPLEMENTATION
 #include "common.h"
 #include "maths.h"
+#include "texture.h"
 #include "mesh.h"
+#include "pack.h"
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -28,22 +30,49 @@ Result file_read(const char* path, Buffer* buffer);
 Result prepare_mesh(Buffer* buffer, Mesh* mesh, const bool sort);
 Result wavefront_parse_mesh(Buffer* buffer, Mesh* mesh);
 Result wavefront_sort_mesh(Mesh* mesh);
+Result atlas_remap_uv(Mesh* mesh, const char* layout_path, const char* texture);
 Result objtoc(Mesh* mesh, const char* name);
+Result objtobin(Mesh* mesh, const char* path);
 
 i32 main(i32 argc, char** argv) {
   if (argc < 3) {
-    fprintf(stdout, "USAGE:\n  %s <path> <name>\n", argv[0]);
+    fprintf(stdout, "USAGE:\n  %s <path> <name> [-a <atlas layout> <texture name>] [-b <pack section>]\n", argv[0]);
     return EXIT_FAILURE;
   }
   char* path = argv[1];
   char* name = argv[2];
+  char* layout_path = NULL;
+  char* texture = NULL;
+  char* section_path = NULL;
+  for (i32 i = 3; i < argc; ++i) {
+    if (!strcmp(argv[i], "-a") && i + 2 < argc) {
+      layout_path = argv[++i];
+      texture = argv[++i];
+    }
+    else if (!strcmp(argv[i], "-b") && i + 1 < argc) {
+      section_path = argv[++i];
+    }
+    else {
+      fprintf(stderr, "warning: unknown option `%s`\n", argv[i]);
+    }
+  }
   Buffer buf;
   Mesh mesh = {0};
   if (file_read(path, &buf) != Error) {
     if (prepare_mesh(&buf, &mesh, true) != Error) {
       if (wavefront_parse_mesh(&buf, &mesh) != Error) {
         if (wavefront_sort_mesh(&mesh) != Error) {
-          objtoc(&mesh, name);
+          if (layout_path && atlas_remap_uv(&mesh, layout_path, texture) != Ok) {
+            return EXIT_FAILURE;
+          }
+          if (section_path) {
+            if (objtobin(&mesh, section_path) != Ok) {
+              return EXIT_FAILURE;
+            }
+          }
+          else {
+            objtoc(&mesh, name);
+          }
         }
       }
     }
@@ -107,9 +136,9 @@ Result prepare_mesh(Buffer* buffer, Mesh* mesh, const bool sort) {
     }
   } while (1);
 
+  // normals keep their own indices, so that vertices shared by faces with different normals keep a normal per face
   if (sort) {
     mesh->uv_count = mesh->uv_index_count;
-    mesh->normal_count = mesh->normal_index_count;
   }
   const u32 size = sizeof(v3) * mesh->vertex_count +
     sizeof(u32) * mesh->vertex_index_count +
@@ -200,24 +229,17 @@ Result wavefront_sort_mesh(Mesh* mesh) {
 
   u32 uv_count = mesh->uv_count;
   v2* uv = malloc(uv_count * sizeof(v2));;
-  u32 normal_count = mesh->normal_count;
-  v3* normal = malloc(normal_count * sizeof(v3));
-  if (uv && normal) {
+  if (uv) {
     memcpy(uv, mesh->uv, uv_count * sizeof(v2));
-    memcpy(normal, mesh->normal, normal_count * sizeof(v3));
 
     for (u32 i = 0; i < mesh->vertex_index_count; ++i) {
-      u32 index = mesh->vertex_index[i];
       u32 uv_index = mesh->uv_index[i];
       (void)uv_index;
-      u32 normal_index = mesh->normal_index[i];
 
       // mesh->uv[i] = uv[uv_index];
-      mesh->normal[index] = normal[normal_index];
     }
 
     free(uv);
-    free(normal);
   }
   else {
     result = Error;
@@ -225,6 +247,57 @@ Result wavefront_sort_mesh(Mesh* mesh) {
   return result;
 }
 
+// move the uvs of the mesh into the rectangle that the atlas tool placed the texture in.
+// the texture can no longer wrap once it is packed, so every uv has to be within [0, 1]
+Result atlas_remap_uv(Mesh* mesh, const char* layout_path, const char* texture) {
+  Result result = Ok;
+  char line[MAX_LINE_SIZE] = {0};
+  char name[MAX_LINE_SIZE] = {0};
+  i32 x = 0, y = 0, width = 0, height = 0, atlas_width = 0, atlas_height = 0;
+  bool found = false;
+  bool* remapped = NULL;
+  FILE* fp = fopen(layout_path, "r");
+  if (!fp) {
+    fprintf(stderr, "atlas_remap_uv: atlas layout `%s` does not exist.\n", layout_path);
+    return_defer(Error);
+  }
+  while (fgets(line, sizeof(line), fp)) {
+    if (sscanf(line, "%255s %d %d %d %d %d %d", name, &x, &y, &width, &height, &atlas_width, &atlas_height) == 7 && !strcmp(name, texture)) {
+      found = true;
+      break;
+    }
+  }
+  if (!found) {
+    fprintf(stderr, "atlas_remap_uv: texture `%s` is not in atlas layout `%s`.\n", texture, layout_path);
+    return_defer(Error);
+  }
+
+  remapped = calloc(mesh->uv_count, sizeof(bool));
+  if (!remapped) {
+    return_defer(Error);
+  }
+  for (u32 i = 0; i < mesh->uv_index_count; ++i) {
+    const u32 index = mesh->uv_index[i];
+    if (index >= mesh->uv_count || remapped[index]) {
+      continue;
+    }
+    v2* uv = &mesh->uv[index];
+    if (uv->x < 0 || uv->x > 1 || uv->y < 0 || uv->y > 1) {
+      fprintf(stderr, "atlas_remap_uv: uv (%g, %g) is outside [0, 1], the mesh relies on texture wrapping and can't use an atlas.\n", uv->x, uv->y);
+      return_defer(Error);
+    }
+    uv->x = (x + uv->x * width) / (f32)atlas_width;
+    uv->y = (y + uv->y * height) / (f32)atlas_height;
+    remapped[index] = true;
+  }
+defer:
+  if (fp) {
+    fclose(fp);
+  }
+  free(remapped);
+  return result;
+}
+
 Result objtoc(Mesh* mesh, const char* name) {
   printf("v3 %s_vertex[] = {", name);
   for (u32 i = 0; i < mesh->vertex_count; ++i) {
@@ -300,3 +373,54 @@ Result objtoc(Mesh* mesh, const char* name) {
   );
   return Ok;
 }
+
+// pad the section to the next PACK_ALIGNMENT boundary
+static u32 section_align(FILE* fp) {
+  static const u8 zero[PACK_ALIGNMENT] = {0};
+  const u32 offset = ftell(fp);
+  const u32 padding = (PACK_ALIGNMENT - (offset % PACK_ALIGNMENT)) % PACK_ALIGNMENT;
+  fwrite(zero, 1, padding, fp);
+  return offset + padding;
+}
+
+// append an array to the section at the next PACK_ALIGNMENT boundary, returning its offset
+static u32 section_append(FILE* fp, const void* data, u32 size) {
+  const u32 offset = section_align(fp);
+  if (size > 0) {
+    fwrite(data, 1, size, fp);
+  }
+  return offset;
+}
+
+// write the mesh as a pack section, laid out so that the game can use the arrays in place
+Result objtobin(Mesh* mesh, const char* path) {
+  FILE* fp = fopen(path, "wb");
+  if (!fp) {
+    fprintf(stderr, "objtobin: failed to open `%s` for writing.\n", path);
+    return Error;
+  }
+  Pack_mesh header = {
+    .type = PACK_ENTRY_MESH,
+    .vertex_count = mesh->vertex_count,
+    .vertex_index_count = mesh->vertex_index_count,
+    .normal_count = mesh->normal_count,
+    .normal_index_count = mesh->normal_index_count,
+    .uv_count = mesh->uv_count,
+    .uv_index_count = mesh->uv_index_count,
+  };
+  for (u32 i = 0; i < mesh->vertex_count; ++i) {
+    mesh->vertex[i].w = 1;
+  }
+  fwrite(&header, 1, sizeof(header), fp);
+  header.vertex = section_append(fp, mesh->vertex, sizeof(v3) * mesh->vertex_count);
+  header.vertex_index = section_append(fp, mesh->vertex_index, sizeof(u32) * mesh->vertex_index_count);
+  header.normal = section_append(fp, mesh->normal, sizeof(v3) * mesh->normal_count);
+  header.normal_index = section_append(fp, mesh->normal_index, sizeof(u32) * mesh->normal_index_count);
+  header.uv = section_append(fp, mesh->uv, sizeof(v2) * mesh->uv_count);
+  header.uv_index = section_append(fp, mesh->uv_index, sizeof(u32) * mesh->uv_index_count);
+  section_align(fp);
+  fseek(fp, 0, SEEK_SET);
+  fwrite(&header, 1, sizeof(header), fp);
+  fclose(fp);
+  return Ok;
+}
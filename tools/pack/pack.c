@@ -0,0 +1,163 @@
+// pack.c
+// combine the sections written by objtoc and pngtoc (with -b) into a single asset pack,
+// and print the declarations that the game loads the pack into
+
+#include <assert.h>
+
+#define COMMON_IMPLEMENTATION
+#include "common.h"
+#include "maths.h"
+#include "texture.h"
+#include "mesh.h"
+#include "pack.h"
+
+#define MAX_ENTRIES 256
+
+#define ALIGN(N, ALIGNMENT) ((((N) + (ALIGNMENT) - 1) / (ALIGNMENT)) * (ALIGNMENT))
+
+typedef struct Section {
+  u8* data;
+  u32 size;
+} Section;
+
+Result section_read(const char* path, Section* section);
+Result section_name(const char* path, char* name);
+void declarations2c(FILE* fp, const char* pack_path, const Pack_entry* entries, u32 count);
+
+static Pack_entry entries[MAX_ENTRIES] = {0};
+static Section sections[MAX_ENTRIES] = {0};
+
+i32 main(i32 argc, char** argv) {
+  i32 result = EXIT_SUCCESS;
+  FILE* fp = NULL;
+  u32 count = 0;
+  if (argc < 3) {
+    printf("Usage; %s <assets.pack> <sections...>\n", argv[0]);
+    printf("  sections are named after their file name, without directory and extension\n");
+    return_defer(EXIT_FAILURE);
+  }
+  const char* pack_path = argv[1];
+  if (argc - 2 > MAX_ENTRIES) {
+    fprintf(stderr, "error: too many sections, max is %d\n", MAX_ENTRIES);
+    return_defer(EXIT_FAILURE);
+  }
+
+  u32 offset = ALIGN(sizeof(Pack_header) + (argc - 2) * sizeof(Pack_entry), PACK_ALIGNMENT);
+  for (i32 i = 2; i < argc; ++i) {
+    Section* section = &sections[count];
+    Pack_entry* entry = &entries[count];
+    if (section_read(argv[i], section) != Ok || section_name(argv[i], entry->name) != Ok) {
+      return_defer(EXIT_FAILURE);
+    }
+    entry->type = *(u32*)section->data;
+    if (entry->type != PACK_ENTRY_MESH && entry->type != PACK_ENTRY_TEXTURE) {
+      fprintf(stderr, "error: `%s` is not a pack section\n", argv[i]);
+      return_defer(EXIT_FAILURE);
+    }
+    for (u32 e = 0; e < count; ++e) {
+      if (!strncmp(entries[e].name, entry->name, PACK_NAME_SIZE)) {
+        fprintf(stderr, "error: duplicate asset name `%s`\n", entry->name);
+        return_defer(EXIT_FAILURE);
+      }
+    }
+    entry->offset = offset;
+    entry->size = section->size;
+    offset += ALIGN(section->size, PACK_ALIGNMENT);
+    count += 1;
+  }
+
+  fp = fopen(pack_path, "wb");
+  if (!fp) {
+    fprintf(stderr, "error: failed to open `%s` for writing\n", pack_path);
+    return_defer(EXIT_FAILURE);
+  }
+  const Pack_header header = {
+    .magic = PACK_MAGIC,
+    .version = PACK_VERSION,
+    .entry_count = count,
+    .size = offset,
+  };
+  static const u8 zero[PACK_ALIGNMENT] = {0};
+  fwrite(&header, sizeof(header), 1, fp);
+  fwrite(entries, sizeof(Pack_entry), count, fp);
+  fwrite(zero, 1, entries[0].offset - (sizeof(Pack_header) + count * sizeof(Pack_entry)), fp);
+  for (u32 i = 0; i < count; ++i) {
+    fwrite(sections[i].data, 1, sections[i].size, fp);
+    fwrite(zero, 1, ALIGN(sections[i].size, PACK_ALIGNMENT) - sections[i].size, fp);
+  }
+  declarations2c(stdout, pack_path, entries, count);
+defer:
+  if (fp) {
+    fclose(fp);
+  }
+  for (u32 i = 0; i < count; ++i) {
+    free(sections[i].data);
+  }
+  return result;
+}
+
+Result section_read(const char* path, Section* section) {
+  Result result = Ok;
+  FILE* fp = fopen(path, "rb");
+  if (!fp) {
+    fprintf(stderr, "error: failed to open section `%s`\n", path);
+    return_defer(Error);
+  }
+  fseek(fp, 0, SEEK_END);
+  section->size = ftell(fp);
+  fseek(fp, 0, SEEK_SET);
+  if (section->size < sizeof(u32)) {
+    fprintf(stderr, "error: `%s` is not a pack section\n", path);
+    return_defer(Error);
+  }
+  section->data = malloc(section->size);
+  if (!section->data || fread(section->data, 1, section->size, fp) != section->size) {
+    fprintf(stderr, "error: failed to read section `%s`\n", path);
+    return_defer(Error);
+  }
+defer:
+  if (fp) {
+    fclose(fp);
+  }
+  return result;
+}
+
+Result section_name(const char* path, char* name) {
+  const char* base = strrchr(path, '/');
+  base = base ? base + 1 : path;
+  const char* extension = strrchr(base, '.');
+  const size_t length = extension ? (size_t)(extension - base) : strlen(base);
+  if (length == 0 || length >= PACK_NAME_SIZE) {
+    fprintf(stderr, "error: asset name of `%s` must be between 1 and %d characters\n", path, PACK_NAME_SIZE - 1);
+    return Error;
+  }
+  memcpy(name, base, length);
+  name[length] = 0;
+  return Ok;
+}
+
+// the declarations only depend on the names and types of the assets, so editing an asset doesn't change them
+void declarations2c(FILE* fp, const char* pack_path, const Pack_entry* entries, u32 count) {
+  fprintf(fp, "// %s\n", pack_path);
+  for (u32 i = 0; i < count; ++i) {
+    const Pack_entry* entry = &entries[i];
+    if (entry->type == PACK_ENTRY_MESH) {
+      fprintf(fp, "Mesh %s = {0};\n", entry->name);
+    }
+    else {
+      fprintf(fp, "Texture %s = {0};\n", entry->name);
+      fprintf(fp, "Texture %s_mips[PACK_MAX_MIPS] = {0};\n", entry->name);
+    }
+  }
+  fprintf(fp, "Pack_asset pack_assets[] = {\n");
+  for (u32 i = 0; i < count; ++i) {
+    const Pack_entry* entry = &entries[i];
+    if (entry->type == PACK_ENTRY_MESH) {
+      fprintf(fp, "  { .name = \"%s\", .mesh = &%s, },\n", entry->name, entry->name);
+    }
+    else {
+      fprintf(fp, "  { .name = \"%s\", .texture = &%s, .mips = %s_mips, },\n", entry->name, entry->name, entry->name);
+    }
+  }
+  fprintf(fp, "};\n");
+}
@@ -8,26 +8,133 @@
 #define COMMON_IMPLEMENTATION
 #include "common.h"
 
+#include "maths.h"
+#include "texture.h"
+#include "mesh.h"
+#include "pack.h"
+
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
 
+#define MAX_MIP_LEVELS 16
+#define PALETTE_SIZE 256
+#define BC1_BLOCK_SIZE 4
+
+#define ALIGN(N, ALIGNMENT) ((((N) + (ALIGNMENT) - 1) / (ALIGNMENT)) * (ALIGNMENT))
+
+// in the same order as Texture_format
+typedef enum Format {
+  FORMAT_RGBA8,
+  FORMAT_PALETTE8,
+  FORMAT_BC1,
+} Format;
+
+static const char* format_names[] = {
+  "rgba",
+  "palette",
+  "bc1",
+};
+
+static const char* texture_format_names[] = {
+  "TEXTURE_FORMAT_RGBA8",
+  "TEXTURE_FORMAT_PALETTE8",
+  "TEXTURE_FORMAT_BC1",
+};
+
+typedef struct Options {
+  bool mipmaps;
+  i32 block_size; // store texels in blocks of block_size x block_size, 0 for row-major
+  Format format;
+  const char* section_path; // write a binary pack section instead of c
+} Options;
+
+typedef struct Image {
+  u32* data;
+  i32 width;
+  i32 height;
+} Image;
+
+typedef struct Encoded {
+  u8* data;
+  u32 size;
+} Encoded;
+
 const char* next(i32* argc, char*** argv);
-Result png2c(FILE* fp, const char* path, const char* name);
+Result png2c(FILE* fp, const char* path, const char* name, const Options* options);
 Result pixels2c(FILE* fp, u32* data, i32 x, i32 y, const char* name);
+Result indices2c(FILE* fp, u8* data, i32 count, const char* name);
+Result level2c(FILE* fp, const Image* level, const char* name, const u32* palette, i32 palette_size, const Options* options);
+Result level_encode(const Image* level, const u32* palette, i32 palette_size, const Options* options, Encoded* encoded);
+Result downsample(const Image* source, Image* dest);
+Result quantize(const Image* image, u32* palette, i32* palette_size);
+u8 nearest_palette_index(u32 color, const u32* palette, i32 palette_size);
+void bc1_encode_block(const u32* texels, u32* block);
+Format level_format(const Image* level, const Options* options);
+size_t level_size(const Image* level, const Options* options);
+bool swizzled(const Image* level, const Options* options);
+void level_fields(const Image* level, const Options* options, Pack_texture_level* fields);
+void texture_fields2c(FILE* fp, const char* name, const char* array_name, const Image* level, const Options* options);
+Result png2bin(const char* path, const Image* levels, i32 level_count, const u32* palette, i32 palette_size, const Options* options);
+bool is_pow2(i32 n);
+i32 log2_pow2(i32 n);
 
 i32 main(i32 argc, char** argv) {
   i32 result = EXIT_SUCCESS;
   if (argc < 3) {
-    printf("Usage; %s <path/to/image.png> <name>\n", argv[0]);
+    printf("Usage; %s <path/to/image.png> <name> [options]\n", argv[0]);
+    printf("  -m          generate box filtered mipmaps\n");
+    printf("  -s <4|8>    store texels in 4x4 or 8x8 blocks\n");
+    printf("  -f <format> texel format, one of rgba (default), palette or bc1\n");
+    printf("  -b <path>   write a binary pack section instead of c\n");
     return_defer(EXIT_FAILURE);
   }
   next(&argc, &argv);
 
   const char* path = next(&argc, &argv);
   const char* name = next(&argc, &argv);
+  Options options = {
+    .mipmaps = false,
+    .block_size = 0,
+    .format = FORMAT_RGBA8,
+    .section_path = NULL,
+  };
+  while (argc > 0) {
+    const char* arg = next(&argc, &argv);
+    if (!strcmp(arg, "-m")) {
+      options.mipmaps = true;
+    }
+    else if (!strcmp(arg, "-s") && argc > 0) {
+      options.block_size = atoi(next(&argc, &argv));
+      if (options.block_size != 4 && options.block_size != 8) {
+        fprintf(stderr, "error: block size must be 4 or 8\n");
+        return_defer(EXIT_FAILURE);
+      }
+    }
+    else if (!strcmp(arg, "-b") && argc > 0) {
+      options.section_path = next(&argc, &argv);
+    }
+    else if (!strcmp(arg, "-f") && argc > 0) {
+      const char* format = next(&argc, &argv);
+      bool found = false;
+      for (u32 i = 0; i < LENGTH(format_names); ++i) {
+        if (!strcmp(format, format_names[i])) {
+          options.format = (Format)i;
+          found = true;
+          break;
+        }
+      }
+      if (!found) {
+        fprintf(stderr, "error: unknown format `%s`\n", format);
+        return_defer(EXIT_FAILURE);
+      }
+    }
+    else {
+      fprintf(stderr, "warning: unknown option `%s`\n", arg);
+    }
+  }
 
   FILE* fp = stdout;
-  if (png2c(fp, path, name) != Ok) {
+  if (png2c(fp, path, name, &options) != Ok) {
     return_defer(EXIT_FAILURE);
   }
 defer:
@@ -42,31 +149,100 @@ const char* next(i32* argc, char*** argv) {
   return result;
 }
 
-Result png2c(FILE* fp, const char* path, const char* name) {
+Result png2c(FILE* fp, const char* path, const char* name, const Options* options) {
   Result result = Ok;
-  u32* data = NULL;
+  Image levels[MAX_MIP_LEVELS] = {0};
+  i32 level_count = 1;
+  char level_name[256] = {0};
+  u32 palette[PALETTE_SIZE] = {0};
+  i32 palette_size = 0;
 
-  i32 x = 0;
-  i32 y = 0;
-  data = (u32*)stbi_load(path, &x, &y, NULL, 4);
-  if (!data) {
+  levels[0].data = (u32*)stbi_load(path, &levels[0].width, &levels[0].height, NULL, 4);
+  if (!levels[0].data) {
     fprintf(stderr, "error: failed to load image `%s`\n", path);
     return_defer(Error);
   }
-  return_defer(pixels2c(fp, data, x, y, name));
+  if (options->mipmaps) {
+    while (level_count < MAX_MIP_LEVELS) {
+      const Image* prev = &levels[level_count - 1];
+      if (prev->width == 1 && prev->height == 1) {
+        break;
+      }
+      if (downsample(prev, &levels[level_count]) != Ok) {
+        return_defer(Error);
+      }
+      level_count += 1;
+    }
+  }
+
+  // every level shares the palette of the full resolution image
+  if (options->format == FORMAT_PALETTE8) {
+    if (quantize(&levels[0], palette, &palette_size) != Ok) {
+      return_defer(Error);
+    }
+  }
+
+  if (options->section_path) {
+    return_defer(png2bin(options->section_path, levels, level_count, palette, palette_size, options));
+  }
+
+#ifdef PRINT_MEMORY_FOOTPRINT
+  size_t size = 0;
+  for (i32 i = 0; i < level_count; ++i) {
+    size += level_size(&levels[i], options);
+  }
+  if (options->format == FORMAT_PALETTE8) {
+    size += PALETTE_SIZE * sizeof(u32);
+  }
+  fprintf(fp, "// %zu kb\n", size / 1024);
+#endif
+  if (options->format == FORMAT_PALETTE8) {
+    snprintf(level_name, sizeof(level_name), "%s_palette", name);
+    pixels2c(fp, palette, PALETTE_SIZE, 1, level_name);
+  }
+  snprintf(level_name, sizeof(level_name), "%s_pixels", name);
+  if (level2c(fp, &levels[0], level_name, palette, palette_size, options) != Ok) {
+    return_defer(Error);
+  }
+  for (i32 i = 1; i < level_count; ++i) {
+    snprintf(level_name, sizeof(level_name), "%s_mip%d_pixels", name, i);
+    if (level2c(fp, &levels[i], level_name, palette, palette_size, options) != Ok) {
+      return_defer(Error);
+    }
+  }
+  if (level_count > 1) {
+    fprintf(fp, "Texture %s_mips[] = {\n", name);
+    for (i32 i = 1; i < level_count; ++i) {
+      snprintf(level_name, sizeof(level_name), "%s_mip%d_pixels", name, i);
+      fprintf(fp, "  { ");
+      texture_fields2c(fp, name, level_name, &levels[i], options);
+      fprintf(fp, "},\n");
+    }
+    fprintf(fp, "};\n");
+    snprintf(level_name, sizeof(level_name), "%s_pixels", name);
+    fprintf(fp, "Texture %s = { ", name);
+    texture_fields2c(fp, name, level_name, &levels[0], options);
+    fprintf(fp, ".mip_count = %d, .mips = %s_mips, };\n", level_count - 1, name);
+  }
+  else {
+    snprintf(level_name, sizeof(level_name), "%s_pixels", name);
+    fprintf(fp, "Texture %s = { ", name);
+    texture_fields2c(fp, name, level_name, &levels[0], options);
+    fprintf(fp, "};\n");
+  }
 defer:
-  if (data) {
-    stbi_image_free(data);
+  if (levels[0].data) {
+    stbi_image_free(levels[0].data);
+  }
+  for (i32 i = 1; i < level_count; ++i) {
+    free(levels[i].data);
   }
   return result;
 }
 
 Result pixels2c(FILE* fp, u32* data, i32 x, i32 y, const char* name) {
   Result result = Ok;
-#ifdef PRINT_MEMORY_FOOTPRINT
-  fprintf(fp, "// %zu kb\n", (x * y * sizeof(u32)) / 1024);
-#endif
-  fprintf(fp, "u32 %s_pixels[] = {\n", name);
+  fprintf(fp, "u32 %s[] = {\n", name);
   u32 index = 0;
   for (u32 py = 0; py < y; ++py) {
     for (u32 px = 0; px < x; ++px) {
@@ -75,7 +251,484 @@ Result pixels2c(FILE* fp, u32* data, i32 x, i32 y, const char* name) {
     }
   }
   fprintf(fp, "};\n");
-  fprintf(fp, "Texture %s = { .data = (Color*)%s_pixels, .width = %d, .height = %d, };\n", name, name, x, y);
   return result;
 }
 
+Result indices2c(FILE* fp, u8* data, i32 count, const char* name) {
+  Result result = Ok;
+  fprintf(fp, "u8 %s[] = {\n", name);
+  for (i32 i = 0; i < count; ++i) {
+    fprintf(fp, "%u,", data[i]);
+  }
+  fprintf(fp, "};\n");
+  return result;
+}
+
+// emit the texels of one level in the format and storage order selected by the options
+Result level2c(FILE* fp, const Image* level, const char* name, const u32* palette, i32 palette_size, const Options* options) {
+  Result result = Ok;
+  Encoded encoded = {0};
+  if (level_encode(level, palette, palette_size, options, &encoded) != Ok) {
+    return_defer(Error);
+  }
+  if (level_format(level, options) == FORMAT_PALETTE8) {
+    return_defer(indices2c(fp, encoded.data, encoded.size, name));
+  }
+  result = pixels2c(fp, (u32*)encoded.data, encoded.size / sizeof(u32), 1, name);
+defer:
+  free(encoded.data);
+  return result;
+}
+
+// texels of one level in the format and storage order selected by the options
+Result level_encode(const Image* level, const u32* palette, i32 palette_size, const Options* options, Encoded* encoded) {
+  Result result = Ok;
+  const i32 count = level->width * level->height;
+  u32* texels = malloc(sizeof(u32) * count);
+  if (!texels) {
+    fprintf(stderr, "error: failed to allocate level\n");
+    return_defer(Error);
+  }
+
+  if (level_format(level, options) == FORMAT_BC1) {
+    u32* dest = texels;
+    for (i32 by = 0; by < level->height; by += BC1_BLOCK_SIZE) {
+      for (i32 bx = 0; bx < level->width; bx += BC1_BLOCK_SIZE) {
+        u32 block_texels[BC1_BLOCK_SIZE * BC1_BLOCK_SIZE];
+        for (i32 y = 0; y < BC1_BLOCK_SIZE; ++y) {
+          for (i32 x = 0; x < BC1_BLOCK_SIZE; ++x) {
+            block_texels[y * BC1_BLOCK_SIZE + x] = level->data[(by + y) * level->width + (bx + x)];
+          }
+        }
+        bc1_encode_block(block_texels, dest);
+        dest += 2;
+      }
+    }
+    encoded->data = (u8*)texels;
+    encoded->size = level_size(level, options);
+    return Ok;
+  }
+
+  if (swizzled(level, options)) {
+    const i32 block_size = options->block_size;
+    u32* dest = texels;
+    for (i32 by = 0; by < level->height; by += block_size) {
+      for (i32 bx = 0; bx < level->width; bx += block_size) {
+        for (i32 y = by; y < by + block_size; ++y) {
+          for (i32 x = bx; x < bx + block_size; ++x) {
+            *dest++ = level->data[y * level->width + x];
+          }
+        }
+      }
+    }
+  }
+  else {
+    memcpy(texels, level->data, sizeof(u32) * count);
+  }
+
+  if (level_format(level, options) == FORMAT_PALETTE8) {
+    u8* indices = malloc(count);
+    if (!indices) {
+      fprintf(stderr, "error: failed to allocate palette indices\n");
+      return_defer(Error);
+    }
+    for (i32 i = 0; i < count; ++i) {
+      indices[i] = nearest_palette_index(texels[i], palette, palette_size);
+    }
+    encoded->data = indices;
+    encoded->size = count;
+    return_defer(Ok);
+  }
+  encoded->data = (u8*)texels;
+  encoded->size = sizeof(u32) * count;
+  return Ok;
+defer:
+  free(texels);
+  return result;
+}
+
+// bc1 levels must divide into whole 4x4 blocks, smaller levels fall back to rgba
+Format level_format(const Image* level, const Options* options) {
+  if (options->format == FORMAT_BC1) {
+    if ((level->width % BC1_BLOCK_SIZE) != 0 || (level->height % BC1_BLOCK_SIZE) != 0) {
+      return FORMAT_RGBA8;
+    }
+  }
+  return options->format;
+}
+
+size_t level_size(const Image* level, const Options* options) {
+  const size_t count = level->width * level->height;
+  switch (level_format(level, options)) {
+    case FORMAT_PALETTE8:
+      return count;
+    case FORMAT_BC1:
+      return count / 2;
+    default:
+      return count * sizeof(u32);
+  }
+}
+
+// levels that don't divide into whole blocks are kept row-major, bc1 is already stored in blocks
+bool swizzled(const Image* level, const Options* options) {
+  if (level_format(level, options) == FORMAT_BC1) {
+    return false;
+  }
+  return options->block_size > 0 && (level->width % options->block_size) == 0 && (level->height % options->block_size) == 0;
+}
+
+// format and dimensions, and the shifts and masks used for addressing power of two and swizzled textures
+void level_fields(const Image* level, const Options* options, Pack_texture_level* fields) {
+  const bool pow2 = is_pow2(level->width) && is_pow2(level->height);
+  const bool swizzle = swizzled(level, options);
+  *fields = (Pack_texture_level) {
+    .width = level->width,
+    .height = level->height,
+    .format = level_format(level, options),
+    .flags = (pow2 ? TEXTURE_POW2 : 0) | (swizzle ? TEXTURE_SWIZZLED : 0),
+    .width_shift = pow2 ? log2_pow2(level->width) : 0,
+    .width_mask = pow2 ? level->width - 1 : 0,
+    .height_mask = pow2 ? level->height - 1 : 0,
+    .block_shift = swizzle ? log2_pow2(options->block_size) : 0,
+  };
+}
+
+void texture_fields2c(FILE* fp, const char* name, const char* array_name, const Image* level, const Options* options) {
+  Pack_texture_level fields;
+  level_fields(level, options, &fields);
+  const Format format = fields.format;
+  switch (format) {
+    case FORMAT_PALETTE8:
+      fprintf(fp, ".indices = %s, .palette = (Color*)%s_palette, ", array_name, name);
+      break;
+    case FORMAT_BC1:
+      fprintf(fp, ".blocks = %s, ", array_name);
+      break;
+    default:
+      fprintf(fp, ".data = (Color*)%s, ", array_name);
+      break;
+  }
+  fprintf(fp, ".width = %d, .height = %d, ", level->width, level->height);
+  if (format != FORMAT_RGBA8) {
+    fprintf(fp, ".format = %s, ", texture_format_names[format]);
+  }
+  if (fields.flags == (TEXTURE_POW2 | TEXTURE_SWIZZLED)) {
+    fprintf(fp, ".flags = TEXTURE_POW2 | TEXTURE_SWIZZLED, ");
+  }
+  else if (fields.flags == TEXTURE_POW2) {
+    fprintf(fp, ".flags = TEXTURE_POW2, ");
+  }
+  else if (fields.flags == TEXTURE_SWIZZLED) {
+    fprintf(fp, ".flags = TEXTURE_SWIZZLED, ");
+  }
+  if (fields.flags & TEXTURE_POW2) {
+    fprintf(fp, ".width_shift = %d, .width_mask = 0x%x, .height_mask = 0x%x, ", fields.width_shift, fields.width_mask, fields.height_mask);
+  }
+  if (fields.flags & TEXTURE_SWIZZLED) {
+    fprintf(fp, ".block_shift = %d, ", fields.block_shift);
+  }
+}
+
+// write the texture as a pack section: the level table, the shared palette and then every level, each array aligned to PACK_ALIGNMENT
+Result png2bin(const char* path, const Image* levels, i32 level_count, const u32* palette, i32 palette_size, const Options* options) {
+  Result result = Ok;
+  static const u8 zero[PACK_ALIGNMENT] = {0};
+  const u32 header_size = sizeof(Pack_texture) + level_count * sizeof(Pack_texture_level);
+  Pack_texture* header = calloc(1, header_size);
+  Encoded encoded = {0};
+  FILE* fp = fopen(path, "wb");
+  if (!header || !fp) {
+    fprintf(stderr, "error: failed to open `%s` for writing\n", path);
+    return_defer(Error);
+  }
+  header->type = PACK_ENTRY_TEXTURE;
+  header->level_count = level_count;
+  u32 offset = ALIGN(header_size, PACK_ALIGNMENT);
+  fwrite(zero, 1, offset, fp); // header is written last, once the offsets are known
+  if (options->format == FORMAT_PALETTE8) {
+    header->palette = offset;
+    fwrite(palette, sizeof(u32), PALETTE_SIZE, fp);
+    offset += ALIGN(PALETTE_SIZE * sizeof(u32), PACK_ALIGNMENT);
+  }
+  for (i32 i = 0; i < level_count; ++i) {
+    Pack_texture_level* fields = &header->levels[i];
+    level_fields(&levels[i], options, fields);
+    if (level_encode(&levels[i], palette, palette_size, options, &encoded) != Ok) {
+      return_defer(Error);
+    }
+    fields->data = offset;
+    fields->size = encoded.size;
+    fwrite(encoded.data, 1, encoded.size, fp);
+    fwrite(zero, 1, ALIGN(encoded.size, PACK_ALIGNMENT) - encoded.size, fp);
+    offset += ALIGN(encoded.size, PACK_ALIGNMENT);
+    free(encoded.data);
+    encoded.data = NULL;
+  }
+  fseek(fp, 0, SEEK_SET);
+  fwrite(header, 1, header_size, fp);
+defer:
+  if (fp) {
+    fclose(fp);
+  }
+  free(header);
+  free(encoded.data);
+  return result;
+}
+
+bool is_pow2(i32 n) {
+  return n > 0 && (n & (n - 1)) == 0;
+}
+
+i32 log2_pow2(i32 n) {
+  i32 result = 0;
+  while ((1 << result) < n) {
+    result += 1;
+  }
+  return result;
+}
+
+// 2x2 box filter, odd edges are clamped
+Result downsample(const Image* source, Image* dest) {
+  dest->width = MAX(source->width / 2, 1);
+  dest->height = MAX(source->height / 2, 1);
+  dest->data = malloc(sizeof(u32) * dest->width * dest->height);
+  if (!dest->data) {
+    fprintf(stderr, "error: failed to allocate mip level\n");
+    return Error;
+  }
+  for (i32 y = 0; y < dest->height; ++y) {
+    for (i32 x = 0; x < dest->width; ++x) {
+      const i32 x1 = MIN(x * 2, source->width - 1);
+      const i32 y1 = MIN(y * 2, source->height - 1);
+      const i32 x2 = MIN(x * 2 + 1, source->width - 1);
+      const i32 y2 = MIN(y * 2 + 1, source->height - 1);
+      const u32 samples[4] = {
+        source->data[y1 * source->width + x1],
+        source->data[y1 * source->width + x2],
+        source->data[y2 * source->width + x1],
+        source->data[y2 * source->width + x2],
+      };
+      u32 texel = 0;
+      for (u32 channel = 0; channel < 4; ++channel) {
+        u32 sum = 2; // round to nearest
+        for (u32 i = 0; i < 4; ++i) {
+          sum += (samples[i] >> (channel * 8)) & 0xff;
+        }
+        texel |= (sum / 4) << (channel * 8);
+      }
+      dest->data[y * dest->width + x] = texel;
+    }
+  }
+  return Ok;
+}
+
+static i32 sort_channel = 0;
+
+static i32 compare_channel(const void* a, const void* b) {
+  const u32 ca = ((*(const u32*)a) >> (sort_channel * 8)) & 0xff;
+  const u32 cb = ((*(const u32*)b) >> (sort_channel * 8)) & 0xff;
+  return (i32)ca - (i32)cb;
+}
+
+static i32 compare_color(const void* a, const void* b) {
+  const u32 ca = *(const u32*)a;
+  const u32 cb = *(const u32*)b;
+  return (ca > cb) - (ca < cb);
+}
+
+typedef struct Box {
+  i32 begin;
+  i32 end;
+} Box;
+
+// channel with the largest extent within the box, and that extent
+static i32 box_widest_channel(const u32* colors, const Box* box, i32* extent) {
+  u32 min[4] = {0xff, 0xff, 0xff, 0xff};
+  u32 max[4] = {0};
+  for (i32 i = box->begin; i < box->end; ++i) {
+    for (u32 channel = 0; channel < 4; ++channel) {
+      const u32 value = (colors[i] >> (channel * 8)) & 0xff;
+      min[channel] = MIN(min[channel], value);
+      max[channel] = MAX(max[channel], value);
+    }
+  }
+  i32 widest = 0;
+  *extent = 0;
+  for (u32 channel = 0; channel < 4; ++channel) {
+    if ((i32)(max[channel] - min[channel]) > *extent) {
+      *extent = max[channel] - min[channel];
+      widest = channel;
+    }
+  }
+  return widest;
+}
+
+// exact palette if the image has few enough colors, median cut otherwise
+Result quantize(const Image* image, u32* palette, i32* palette_size) {
+  Result result = Ok;
+  const i32 count = image->width * image->height;
+  u32* colors = malloc(sizeof(u32) * count);
+  if (!colors) {
+    fprintf(stderr, "error: failed to allocate palette colors\n");
+    return Error;
+  }
+  memcpy(colors, image->data, sizeof(u32) * count);
+  qsort(colors, count, sizeof(u32), compare_color);
+  i32 unique = 0;
+  for (i32 i = 0; i < count; ++i) {
+    if (i == 0 || colors[i] != colors[i - 1]) {
+      if (unique < PALETTE_SIZE) {
+        palette[unique] = colors[i];
+      }
+      unique += 1;
+    }
+  }
+  if (unique <= PALETTE_SIZE) {
+    *palette_size = unique;
+    return_defer(Ok);
+  }
+
+  // split the box with the widest channel at its median until the palette is full
+  Box boxes[PALETTE_SIZE] = { { .begin = 0, .end = count, } };
+  i32 box_count = 1;
+  while (box_count < PALETTE_SIZE) {
+    i32 split = -1;
+    i32 split_extent = 0;
+    i32 split_channel = 0;
+    for (i32 i = 0; i < box_count; ++i) {
+      i32 extent = 0;
+      const i32 channel = box_widest_channel(colors, &boxes[i], &extent);
+      if (extent > split_extent) {
+        split = i;
+        split_extent = extent;
+        split_channel = channel;
+      }
+    }
+    if (split < 0) {
+      break;
+    }
+    Box* box = &boxes[split];
+    sort_channel = split_channel;
+    qsort(&colors[box->begin], box->end - box->begin, sizeof(u32), compare_channel);
+    const i32 median = box->begin + (box->end - box->begin) / 2;
+    boxes[box_count++] = (Box) { .begin = median, .end = box->end, };
+    box->end = median;
+  }
+  for (i32 i = 0; i < box_count; ++i) {
+    u32 color = 0;
+    const u32 size = boxes[i].end - boxes[i].begin;
+    for (u32 channel = 0; channel < 4; ++channel) {
+      u32 sum = size / 2;
+      for (i32 c = boxes[i].begin; c < boxes[i].end; ++c) {
+        sum += (colors[c] >> (channel * 8)) & 0xff;
+      }
+      color |= (sum / size) << (channel * 8);
+    }
+    palette[i] = color;
+  }
+  *palette_size = box_count;
+defer:
+  free(colors);
+  return result;
+}
+
+static u32 color_distance(u32 a, u32 b) {
+  u32 distance = 0;
+  for (u32 channel = 0; channel < 4; ++channel) {
+    const i32 delta = (i32)((a >> (channel * 8)) & 0xff) - (i32)((b >> (channel * 8)) & 0xff);
+    distance += delta * delta;
+  }
+  return distance;
+}
+
+u8 nearest_palette_index(u32 color, const u32* palette, i32 palette_size) {
+  u8 nearest = 0;
+  u32 nearest_distance = UINT32_MAX;
+  for (i32 i = 0; i < palette_size; ++i) {
+    const u32 distance = color_distance(color, palette[i]);
+    if (distance < nearest_distance) {
+      nearest = i;
+      nearest_distance = distance;
+      if (distance == 0) {
+        break;
+      }
+    }
+  }
+  return nearest;
+}
+
+static u32 rgb565(u32 color) {
+  const u32 r = color & 0xff;
+  const u32 g = (color >> 8) & 0xff;
+  const u32 b = (color >> 16) & 0xff;
+  return ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+}
+
+static u32 rgb565_to_color(u32 c) {
+  const u32 r = (c >> 11) & 0x1f;
+  const u32 g = (c >> 5) & 0x3f;
+  const u32 b = c & 0x1f;
+  return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16) | 0xff000000;
+}
+
+static u32 color_mix(u32 a, u32 b, u32 weight_a, u32 weight_b) {
+  u32 color = 0xff000000;
+  for (u32 channel = 0; channel < 3; ++channel) {
+    const u32 ca = (a >> (channel * 8)) & 0xff;
+    const u32 cb = (b >> (channel * 8)) & 0xff;
+    color |= ((ca * weight_a + cb * weight_b) / (weight_a + weight_b)) << (channel * 8);
+  }
+  return color;
+}
+
+// endpoints from the inset bounding box of the block colors, four color mode only
+void bc1_encode_block(const u32* texels, u32* block) {
+  u32 min[3] = {0xff, 0xff, 0xff};
+  u32 max[3] = {0};
+  for (u32 i = 0; i < BC1_BLOCK_SIZE * BC1_BLOCK_SIZE; ++i) {
+    for (u32 channel = 0; channel < 3; ++channel) {
+      const u32 value = (texels[i] >> (channel * 8)) & 0xff;
+      min[channel] = MIN(min[channel], value);
+      max[channel] = MAX(max[channel], value);
+    }
+  }
+  u32 color_min = 0;
+  u32 color_max = 0;
+  for (u32 channel = 0; channel < 3; ++channel) {
+    const u32 inset = (max[channel] - min[channel]) / 16;
+    color_min |= (min[channel] + inset) << (channel * 8);
+    color_max |= (max[channel] - inset) << (channel * 8);
+  }
+  u32 c0 = rgb565(color_max);
+  u32 c1 = rgb565(color_min);
+  if (c0 < c1) {
+    const u32 tmp = c0;
+    c0 = c1;
+    c1 = tmp;
+  }
+  block[0] = c0 | (c1 << 16);
+  block[1] = 0;
+  if (c0 == c1) {
+    return;
+  }
+  const u32 e0 = rgb565_to_color(c0);
+  const u32 e1 = rgb565_to_color(c1);
+  const u32 entries[4] = {
+    e0,
+    e1,
+    color_mix(e0, e1, 2, 1),
+    color_mix(e0, e1, 1, 2),
+  };
+  for (u32 i = 0; i < BC1_BLOCK_SIZE * BC1_BLOCK_SIZE; ++i) {
+    u32 selector = 0;
+    u32 nearest_distance = UINT32_MAX;
+    for (u32 e = 0; e < 4; ++e) {
+      const u32 distance = color_distance(texels[i] | 0xff000000, entries[e]);
+      if (distance < nearest_distance) {
+        selector = e;
+        nearest_distance = distance;
+      }
+    }
+    block[1] |= selector << (i * 2);
+  }
+}